@@ -156,7 +156,7 @@ int main() {
         svklib::graphics::pipeline pipeline = pipelineBuilder.buildPipeline(VK_NULL_HANDLE);
         
         svklib::instance::svkimage textureImage = inst.create2DImageFromFile("res/textures/perlin.bmp",4);
-        inst.createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        inst.createImageView(textureImage, textureImage.format, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         inst.createSampler(textureImage,VK_FILTER_LINEAR,VK_SAMPLER_ADDRESS_MODE_REPEAT);
         
         svklib::instance::svkbuffer vertexBuffer = inst.createBufferStaged(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.size()*sizeof(Vertex), vertices.data());
@@ -15,6 +15,7 @@
 #include <map>
 #include <optional>
 #include <set>
+#include <array>
 #include <memory>
 
 #include <deque>
@@ -0,0 +1,417 @@
+#ifndef SVKLIB_BCN_CPP
+#define SVKLIB_BCN_CPP
+
+#include "svk_bcn.hpp"
+
+#include "svk_threadpool.hpp"
+
+#include <cmath>
+#include <cfloat>
+
+namespace svklib {
+
+bcn_encoder::format bcn_encoder::fromVkFormat(VkFormat vkFormat)
+{
+    switch (vkFormat) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            return format::bc1;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            return format::bc3;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return format::bc7;
+        default:
+            throw std::runtime_error("the block encoder only writes BC1, BC3 and BC7!");
+    }
+}
+
+VkFormat bcn_encoder::toVkFormat(format f, bool srgb)
+{
+    switch (f) {
+        case format::bc1: return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case format::bc3: return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+        default: return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+}
+
+VkDeviceSize bcn_encoder::blockBytes(format f)
+{
+    return f == format::bc1 ? 8 : 16;
+}
+
+VkDeviceSize bcn_encoder::encodedSize(format f, uint32_t width, uint32_t height)
+{
+    return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(f);
+}
+
+//endpoints of the block along its principal axis, the first channels of each texel are used
+static void principalEndpoints(const uint8_t* texels, int channels, float e0[4], float e1[4])
+{
+    float mean[4] = {};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < channels; c++)
+            mean[c] += texels[i * 4 + c];
+    }
+    for (int c = 0; c < channels; c++)
+        mean[c] /= 16.0f;
+
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; i++) {
+        float d[4] = {};
+        for (int c = 0; c < channels; c++)
+            d[c] = texels[i * 4 + c] - mean[c];
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                cov[a][b] += d[a] * d[b];
+        }
+    }
+
+    //flat only when no channel varies at all, then both endpoints are the mean
+    float trace = 0.0f;
+    int widest = 0;
+    for (int c = 0; c < channels; c++) {
+        trace += cov[c][c];
+        if (cov[c][c] > cov[widest][widest])
+            widest = c;
+    }
+    float axis[4] = {};
+    if (trace > 1e-4f) {
+        //start along the bounding box diagonal rather than a fixed (1,1,1), which is orthogonal
+        //to blocks whose channels move against each other and collapsed them to a flat color
+        float lo[4] = {255.0f, 255.0f, 255.0f, 255.0f};
+        float hi[4] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < channels; c++) {
+                lo[c] = std::min(lo[c], static_cast<float>(texels[i * 4 + c]));
+                hi[c] = std::max(hi[c], static_cast<float>(texels[i * 4 + c]));
+            }
+        }
+        //the box has no direction per channel, flip the channels that fall while the widest one rises
+        for (int c = 0; c < channels; c++)
+            axis[c] = cov[widest][c] < 0.0f ? lo[c] - hi[c] : hi[c] - lo[c];
+
+        //power iteration, a handful of steps is enough for 16 points
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = {};
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++)
+                    next[a] += cov[a][b] * axis[b];
+            }
+            float length = 0.0f;
+            for (int c = 0; c < channels; c++)
+                length += next[c] * next[c];
+            if (length < 1e-8f) {
+                //the start was orthogonal to every direction the block varies in, use the widest channel
+                for (int c = 0; c < channels; c++)
+                    axis[c] = c == widest ? 1.0f : 0.0f;
+                continue;
+            }
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; c++)
+                axis[c] = next[c] / length;
+        }
+    }
+
+    float tMin = 0.0f;
+    float tMax = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 4; c++) {
+        e0[c] = c < channels ? std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f) : 255.0f;
+        e1[c] = c < channels ? std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f) : 255.0f;
+    }
+}
+
+static uint16_t pack565(const float c[4])
+{
+    const uint32_t r = static_cast<uint32_t>(c[0] * 31.0f / 255.0f + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(c[1] * 63.0f / 255.0f + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(c[2] * 31.0f / 255.0f + 0.5f);
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(uint16_t v, int out[3])
+{
+    const int r = (v >> 11) & 31;
+    const int g = (v >> 5) & 63;
+    const int b = v & 31;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+//8 byte BC1 color block, always in 4 color mode so it is also the color half of BC3
+static void encodeColorBlock(const uint8_t* texels, uint8_t* out)
+{
+    float e0[4], e1[4];
+    principalEndpoints(texels, 3, e0, e1);
+    uint16_t c0 = pack565(e1);
+    uint16_t c1 = pack565(e0);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    //equal endpoints leave every index at 0
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 4; p++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    const int d = texels[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (2 * i);
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(c0);
+    out[1] = static_cast<uint8_t>(c0 >> 8);
+    out[2] = static_cast<uint8_t>(c1);
+    out[3] = static_cast<uint8_t>(c1 >> 8);
+    for (int b = 0; b < 4; b++)
+        out[4 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+//8 byte BC3 alpha block in 8 value mode
+static void encodeAlphaBlock(const uint8_t* texels, uint8_t* out)
+{
+    int a0 = 0;
+    int a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max(a0, static_cast<int>(texels[i * 4 + 3]));
+        a1 = std::min(a1, static_cast<int>(texels[i * 4 + 3]));
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int palette[8];
+        palette[0] = a0;
+        palette[1] = a1;
+        for (int k = 1; k < 7; k++)
+            palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 8; p++) {
+                const int error = std::abs(texels[i * 4 + 3] - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= static_cast<uint64_t>(best) << (3 * i);
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(a0);
+    out[1] = static_cast<uint8_t>(a1);
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = static_cast<uint8_t>(indices >> (8 * b));
+}
+
+//7 bits per channel and a p bit shared by the channels of the endpoint
+static void quantizeMode6(const float e[4], uint8_t q[4], uint8_t& pBit)
+{
+    float bestError = FLT_MAX;
+    for (uint8_t p = 0; p < 2; p++) {
+        uint8_t candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            const int v = std::clamp(static_cast<int>((e[c] - p) / 2.0f + 0.5f), 0, 127);
+            candidate[c] = static_cast<uint8_t>(v);
+            const float d = static_cast<float>((v << 1) | p) - e[c];
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pBit = p;
+            memcpy(q, candidate, 4);
+        }
+    }
+}
+
+struct bitWriter {
+    uint8_t* out;
+    uint32_t position = 0;
+    void push(uint32_t value, uint32_t bits) {
+        for (uint32_t b = 0; b < bits; b++, position++) {
+            if ((value >> b) & 1)
+                out[position >> 3] |= static_cast<uint8_t>(1u << (position & 7));
+        }
+    }
+};
+
+//16 byte BC7 block in mode 6
+static void encodeBC7Block(const uint8_t* texels, uint8_t* out)
+{
+    static constexpr int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    float e0[4], e1[4];
+    principalEndpoints(texels, 4, e0, e1);
+    uint8_t q[2][4];
+    uint8_t p[2];
+    quantizeMode6(e0, q[0], p[0]);
+    quantizeMode6(e1, q[1], p[1]);
+
+    int endpoints[2][4];
+    for (int k = 0; k < 2; k++) {
+        for (int c = 0; c < 4; c++)
+            endpoints[k][c] = (q[k][c] << 1) | p[k];
+    }
+    int palette[16][4];
+    for (int w = 0; w < 16; w++) {
+        for (int c = 0; c < 4; c++)
+            palette[w][c] = ((64 - weights[w]) * endpoints[0][c] + weights[w] * endpoints[1][c] + 32) >> 6;
+    }
+
+    uint8_t indices[16];
+    for (int i = 0; i < 16; i++) {
+        int best = 0;
+        int bestError = INT32_MAX;
+        for (int w = 0; w < 16; w++) {
+            int error = 0;
+            for (int c = 0; c < 4; c++) {
+                const int d = texels[i * 4 + c] - palette[w][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = w;
+            }
+        }
+        indices[i] = static_cast<uint8_t>(best);
+    }
+
+    //the top bit of the first index is implied 0, swapping the endpoints mirrors the weights
+    if (indices[0] & 8) {
+        std::swap(q[0], q[1]);
+        std::swap(p[0], p[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = static_cast<uint8_t>(15 - indices[i]);
+    }
+
+    memset(out, 0, 16);
+    bitWriter writer{out};
+    writer.push(1u << 6, 7); //mode 6
+    for (int c = 0; c < 4; c++) {
+        writer.push(q[0][c], 7);
+        writer.push(q[1][c], 7);
+    }
+    writer.push(p[0], 1);
+    writer.push(p[1], 1);
+    writer.push(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        writer.push(indices[i], 4);
+}
+
+struct bcn_encoder::job {
+    format f;
+    const uint8_t* rgba;
+    uint32_t width;
+    uint32_t height;
+    uint8_t* out;
+    uint32_t blocksX;
+    uint32_t blocksY;
+    uint32_t tileRows; //block rows per tile
+    uint32_t tileCount;
+    std::atomic<uint32_t> nextTile{0};
+    std::atomic<uint32_t> doneTiles{0};
+};
+
+void bcn_encoder::encodeTiles(job& j)
+{
+    const VkDeviceSize bytes = blockBytes(j.f);
+    uint8_t block[64];
+    for (;;) {
+        const uint32_t tile = j.nextTile.fetch_add(1, std::memory_order_relaxed);
+        if (tile >= j.tileCount)
+            return;
+
+        const uint32_t lastRow = std::min((tile + 1) * j.tileRows, j.blocksY);
+        for (uint32_t by = tile * j.tileRows; by < lastRow; by++) {
+            for (uint32_t bx = 0; bx < j.blocksX; bx++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    const uint32_t sy = std::min(by * 4 + y, j.height - 1);
+                    for (uint32_t x = 0; x < 4; x++) {
+                        const uint32_t sx = std::min(bx * 4 + x, j.width - 1);
+                        memcpy(block + (y * 4 + x) * 4, j.rgba + (static_cast<size_t>(sy) * j.width + sx) * 4, 4);
+                    }
+                }
+
+                uint8_t* dst = j.out + (static_cast<size_t>(by) * j.blocksX + bx) * bytes;
+                switch (j.f) {
+                    case format::bc1:
+                        encodeColorBlock(block, dst);
+                        break;
+                    case format::bc3:
+                        encodeAlphaBlock(block, dst);
+                        encodeColorBlock(block, dst + 8);
+                        break;
+                    case format::bc7:
+                        encodeBC7Block(block, dst);
+                        break;
+                }
+            }
+        }
+        j.doneTiles.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void bcn_encoder::encode(format f, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out)
+{
+    if (width == 0 || height == 0)
+        return;
+
+    //shared with the helpers, a helper that starts after the last tile only touches the counters
+    std::shared_ptr<job> j = std::make_shared<job>();
+    j->f = f;
+    j->rgba = rgba;
+    j->width = width;
+    j->height = height;
+    j->out = out;
+    j->blocksX = (width + 3) / 4;
+    j->blocksY = (height + 3) / 4;
+    //about 4096 blocks per tile
+    j->tileRows = std::max(1u, 4096u / j->blocksX);
+    j->tileCount = (j->blocksY + j->tileRows - 1) / j->tileRows;
+
+    const uint32_t helpers = std::min(j->tileCount - 1, std::max(1u, std::thread::hardware_concurrency()) - 1);
+    threadpool* pool = threadpool::get_instance();
+    for (uint32_t i = 0; i < helpers; i++) {
+        pool->add_task([j]() { encodeTiles(*j); });
+    }
+
+    //the caller takes tiles as well, so nothing waits on a pool whose workers are all busy
+    encodeTiles(*j);
+    while (j->doneTiles.load(std::memory_order_acquire) != j->tileCount) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_BCN_CPP
@@ -0,0 +1,33 @@
+#ifndef SVKLIB_BCN_HPP
+#define SVKLIB_BCN_HPP
+
+#include "svk_forward_declarations.hpp"
+
+namespace svklib {
+
+//cpu block compression of RGBA8 images into BC1, BC3 or BC7
+//endpoints come from the principal axis of each block, BC7 uses mode 6 (one subset, rgba, 4 bit indices)
+//rows of blocks are split into tiles and encoded in parallel on the threadpool
+class bcn_encoder {
+public:
+    enum class format { bc1, bc3, bc7 };
+
+    //throws for formats other than BC1 (rgb or rgba), BC3 and BC7
+    static format fromVkFormat(VkFormat vkFormat);
+    static VkFormat toVkFormat(format f, bool srgb);
+    static VkDeviceSize blockBytes(format f);
+    static VkDeviceSize encodedSize(format f, uint32_t width, uint32_t height);
+
+    //rgba holds width * height texels, out holds encodedSize() bytes
+    //blocks past the edge repeat the last row and column, the calling thread encodes tiles too,
+    //so it is safe to call from a threadpool task
+    static void encode(format f, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* out);
+
+private:
+    struct job;
+    static void encodeTiles(job& j);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_BCN_HPP
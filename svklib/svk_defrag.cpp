@@ -0,0 +1,480 @@
+#ifndef SVKLIB_DEFRAG_CPP
+#define SVKLIB_DEFRAG_CPP
+
+#include "svk_defrag.hpp"
+
+#include "svk_memory.hpp"
+
+namespace svklib {
+
+defragmenter::defragmenter(instance& inst, uint32_t framesInFlight, uint32_t maxMovesPerPass, VkDeviceSize maxBytesPerPass)
+    : inst(inst), framesInFlight(framesInFlight), maxMovesPerPass(maxMovesPerPass), maxBytesPerPass(maxBytesPerPass)
+{}
+
+defragmenter::~defragmenter()
+{
+    finish();
+}
+
+void defragmenter::registerBuffer(instance::svkbuffer* buffer, VkBufferCreateInfo createInfo)
+{
+    if (createInfo.sharingMode == VK_SHARING_MODE_CONCURRENT) {
+        throw std::runtime_error("concurrent buffers can not be defragmented!");
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    resource res{};
+    res.buffer = buffer;
+    res.bufferInfo = createInfo;
+    //the replacement is filled by a copy
+    res.bufferInfo.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    res.bufferInfo.pNext = nullptr;
+    resources[buffer->alloc] = res;
+}
+
+void defragmenter::registerImage(instance::svkimage* image, VkImageCreateInfo createInfo, VkImageLayout layout, VkImageViewType viewType, VkImageAspectFlags aspectFlags)
+{
+    if (layout == VK_IMAGE_LAYOUT_UNDEFINED || layout == VK_IMAGE_LAYOUT_PREINITIALIZED) {
+        throw std::runtime_error("image layout can not be kept across a move!");
+    }
+    if (createInfo.sharingMode == VK_SHARING_MODE_CONCURRENT) {
+        throw std::runtime_error("concurrent images can not be defragmented!");
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    resource res{};
+    res.image = image;
+    res.imageInfo = createInfo;
+    res.imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    res.imageInfo.pNext = nullptr;
+    res.imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    res.layout = layout;
+    res.viewType = viewType;
+    res.aspectFlags = aspectFlags;
+    resources[image->alloc] = res;
+}
+
+bool defragmenter::isMoving(VmaAllocation alloc)
+{
+    for (relocation& r : relocations) {
+        if (r.alloc == alloc)
+            return true;
+    }
+    return false;
+}
+
+void defragmenter::unregisterBuffer(instance::svkbuffer* buffer)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (passActive && isMoving(buffer->alloc))
+        finish();
+    resources.erase(buffer->alloc);
+    std::erase_if(descriptors, [buffer](const descriptor& d) { return d.resource == buffer; });
+}
+
+void defragmenter::unregisterImage(instance::svkimage* image)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (passActive && isMoving(image->alloc))
+        finish();
+    resources.erase(image->alloc);
+    std::erase_if(descriptors, [image](const descriptor& d) { return d.resource == image; });
+}
+
+void defragmenter::registerDescriptor(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+                                      instance::svkbuffer* buffer, VkDeviceSize offset, VkDeviceSize range, uint32_t frame)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    descriptors.push_back({set, binding, arrayElement, type, buffer, offset, range, VK_IMAGE_LAYOUT_UNDEFINED, frame});
+}
+
+void defragmenter::registerDescriptor(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+                                      instance::svkimage* image, VkImageLayout layout, uint32_t frame)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    descriptors.push_back({set, binding, arrayElement, type, image, 0, 0, layout, frame});
+}
+
+void defragmenter::unregisterDescriptors(VkDescriptorSet set)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::erase_if(descriptors, [set](const descriptor& d) { return d.set == set; });
+}
+
+void defragmenter::start()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (running())
+        return;
+
+    //vma defragments one pool at a time, the default pools first then every memory_pools pool
+    pendingPools = inst.getMemoryPools().getPools();
+    beginDefragmentation(VK_NULL_HANDLE);
+}
+
+void defragmenter::beginDefragmentation(VmaPool pool)
+{
+    VmaDefragmentationInfo defragInfo{};
+    defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+    defragInfo.pool = pool;
+    defragInfo.maxBytesPerPass = maxBytesPerPass;
+    defragInfo.maxAllocationsPerPass = maxMovesPerPass;
+
+    if (vmaBeginDefragmentation(inst.allocator, &defragInfo, &context) != VK_SUCCESS) {
+        context = VK_NULL_HANDLE;
+        pendingPools.clear();
+        throw std::runtime_error("failed to begin defragmentation!");
+    }
+}
+
+bool defragmenter::step(uint32_t frame)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (!running())
+        return false;
+
+    if (!passActive) {
+        beginPass();
+        return false;
+    }
+
+    //frames keep using the old resources until the copy is done
+    if (!swapped) {
+        if (!copies.ready())
+            return false;
+        swapHandles();
+        swapped = true;
+    }
+
+    //the previous submission of this slot has completed, nothing in flight reads its sets
+    if (frame < framesInFlight && !slotsRewritten[frame]) {
+        rewriteDescriptors(frame);
+        slotsRewritten[frame] = true;
+    }
+
+    if (std::find(slotsRewritten.begin(), slotsRewritten.end(), false) != slotsRewritten.end())
+        return true;
+
+    //every frame recorded with the old handles has completed
+    bool shared = false;
+    for (descriptor& d : descriptors) {
+        if (d.frame == allFrames) {
+            shared = true;
+            break;
+        }
+    }
+    if (shared) {
+        inst.graphicsQueue.waitIdle();
+        rewriteDescriptors(allFrames);
+    }
+    endPass();
+    return true;
+}
+
+void defragmenter::finish()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    pendingPools.clear();
+    if (passActive) {
+        copies.wait();
+        if (!swapped) {
+            swapHandles();
+            swapped = true;
+        }
+        inst.graphicsQueue.waitIdle();
+        for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+            if (!slotsRewritten[frame])
+                rewriteDescriptors(frame);
+        }
+        rewriteDescriptors(allFrames);
+        endPass();
+    }
+    if (running())
+        endDefragmentation();
+}
+
+void defragmenter::beginPass()
+{
+    VkResult result = vmaBeginDefragmentationPass(inst.allocator, context, &passInfo);
+    if (result == VK_SUCCESS) {
+        //nothing left to move
+        endDefragmentation();
+        return;
+    }
+    if (result != VK_INCOMPLETE) {
+        throw std::runtime_error("failed to begin defragmentation pass!");
+    }
+
+    relocations.clear();
+    for (uint32_t i = 0; i < passInfo.moveCount; i++) {
+        VmaDefragmentationMove& move = passInfo.pMoves[i];
+
+        auto it = resources.find(move.srcAllocation);
+        if (it == resources.end()) {
+            //not registered, nobody could update its handles
+            move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+            continue;
+        }
+
+        relocation r{};
+        r.alloc = move.srcAllocation;
+        r.res = it->second;
+
+        if (r.res.buffer != nullptr) {
+            if (vkCreateBuffer(inst.device, &r.res.bufferInfo, nullptr, &r.newBuffer) != VK_SUCCESS) {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+            if (vmaBindBufferMemory(inst.allocator, move.dstTmpAllocation, r.newBuffer) != VK_SUCCESS) {
+                vkDestroyBuffer(inst.device, r.newBuffer, nullptr);
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+            r.oldBuffer = r.res.buffer->buff;
+        } else {
+            if (vkCreateImage(inst.device, &r.res.imageInfo, nullptr, &r.newImage) != VK_SUCCESS) {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+            if (vmaBindImageMemory(inst.allocator, move.dstTmpAllocation, r.newImage) != VK_SUCCESS) {
+                vkDestroyImage(inst.device, r.newImage, nullptr);
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+            r.oldImage = r.res.image->image;
+            r.oldView = r.res.image->view;
+            if (r.oldView.has_value()) {
+                r.newView = createImageView(inst.device, r.newImage, r.res.imageInfo.format, r.res.viewType, r.res.aspectFlags, r.res.imageInfo.mipLevels);
+            }
+        }
+        relocations.push_back(r);
+    }
+
+    passActive = true;
+    swapped = false;
+    slotsRewritten.assign(framesInFlight, false);
+    stats.passes++;
+
+    if (relocations.empty()) {
+        endPass();
+        return;
+    }
+
+    instance::CommandPool commandPool = inst.getCommandPool();
+    VkCommandBuffer commandBuffer = inst.beginSingleTimeCommands(commandPool.get());
+    recordCopies(commandBuffer);
+    copies = inst.endSingleTimeCommandsAsync(commandPool.get(), commandBuffer);
+}
+
+static VkImageMemoryBarrier moveBarrier(VkImage image, const VkImageCreateInfo& imageInfo, VkImageAspectFlags aspectFlags,
+                                        VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = aspectFlags;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = imageInfo.mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = imageInfo.arrayLayers;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    return barrier;
+}
+
+void defragmenter::recordCopies(VkCommandBuffer commandBuffer)
+{
+    //waits for every earlier submission on the queue, including frames still reading the old resources
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (relocation& r : relocations) {
+        if (r.newImage == VK_NULL_HANDLE)
+            continue;
+        barriers.push_back(moveBarrier(r.oldImage, r.res.imageInfo, r.res.aspectFlags,
+            r.res.layout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_MEMORY_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+        barriers.push_back(moveBarrier(r.newImage, r.res.imageInfo, r.res.aspectFlags,
+            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+    }
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &memoryBarrier,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    for (relocation& r : relocations) {
+        if (r.newBuffer != VK_NULL_HANDLE) {
+            VkBufferCopy region{};
+            region.size = r.res.bufferInfo.size;
+            vkCmdCopyBuffer(commandBuffer, r.oldBuffer, r.newBuffer, 1, &region);
+            continue;
+        }
+
+        std::vector<VkImageCopy> regions(r.res.imageInfo.mipLevels);
+        for (uint32_t level = 0; level < r.res.imageInfo.mipLevels; level++) {
+            VkImageCopy& region = regions[level];
+            region.srcSubresource.aspectMask = r.res.aspectFlags;
+            region.srcSubresource.mipLevel = level;
+            region.srcSubresource.baseArrayLayer = 0;
+            region.srcSubresource.layerCount = r.res.imageInfo.arrayLayers;
+            region.dstSubresource = region.srcSubresource;
+            region.srcOffset = {0, 0, 0};
+            region.dstOffset = {0, 0, 0};
+            region.extent.width = std::max(1u, r.res.imageInfo.extent.width >> level);
+            region.extent.height = std::max(1u, r.res.imageInfo.extent.height >> level);
+            region.extent.depth = std::max(1u, r.res.imageInfo.extent.depth >> level);
+        }
+        vkCmdCopyImage(commandBuffer,
+            r.oldImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            r.newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    barriers.clear();
+    for (relocation& r : relocations) {
+        if (r.newImage == VK_NULL_HANDLE)
+            continue;
+        barriers.push_back(moveBarrier(r.oldImage, r.res.imageInfo, r.res.aspectFlags,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, r.res.layout, 0, VK_ACCESS_MEMORY_READ_BIT));
+        barriers.push_back(moveBarrier(r.newImage, r.res.imageInfo, r.res.aspectFlags,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, r.res.layout, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT));
+    }
+
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        1, &memoryBarrier,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+void defragmenter::swapHandles()
+{
+    for (relocation& r : relocations) {
+        if (r.res.buffer != nullptr) {
+            r.res.buffer->buff = r.newBuffer;
+        } else {
+            r.res.image->image = r.newImage;
+            r.res.image->view = r.newView;
+        }
+        if (onRelocate != nullptr) {
+            onRelocate(r.res.buffer != nullptr ? static_cast<void*>(r.res.buffer) : static_cast<void*>(r.res.image));
+        }
+    }
+}
+
+void defragmenter::rewriteDescriptors(uint32_t frame)
+{
+    std::vector<VkWriteDescriptorSet> writes;
+    std::vector<VkDescriptorBufferInfo> bufferInfos;
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    //pointers into these are taken below
+    bufferInfos.reserve(descriptors.size());
+    imageInfos.reserve(descriptors.size());
+
+    for (descriptor& d : descriptors) {
+        if (d.frame != frame)
+            continue;
+
+        relocation* moved = nullptr;
+        for (relocation& r : relocations) {
+            if (d.resource == r.res.buffer || d.resource == r.res.image) {
+                moved = &r;
+                break;
+            }
+        }
+        if (moved == nullptr)
+            continue;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = d.set;
+        write.dstBinding = d.binding;
+        write.dstArrayElement = d.arrayElement;
+        write.descriptorCount = 1;
+        write.descriptorType = d.type;
+
+        if (moved->res.buffer != nullptr) {
+            VkDescriptorBufferInfo& bufferInfo = bufferInfos.emplace_back();
+            bufferInfo.buffer = moved->newBuffer;
+            bufferInfo.offset = d.offset;
+            bufferInfo.range = d.range;
+            write.pBufferInfo = &bufferInfo;
+        } else {
+            VkDescriptorImageInfo& imageInfo = imageInfos.emplace_back();
+            imageInfo.sampler = moved->res.image->sampler.value_or(VK_NULL_HANDLE);
+            imageInfo.imageView = moved->newView.value_or(VK_NULL_HANDLE);
+            imageInfo.imageLayout = d.layout;
+            write.pImageInfo = &imageInfo;
+        }
+        writes.push_back(write);
+    }
+
+    if (!writes.empty()) {
+        vkUpdateDescriptorSets(inst.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void defragmenter::endPass()
+{
+    //nothing references the old handles anymore
+    for (relocation& r : relocations) {
+        if (r.oldBuffer != VK_NULL_HANDLE)
+            vkDestroyBuffer(inst.device, r.oldBuffer, nullptr);
+        if (r.oldView.has_value())
+            vkDestroyImageView(inst.device, r.oldView.value(), nullptr);
+        if (r.oldImage != VK_NULL_HANDLE)
+            vkDestroyImage(inst.device, r.oldImage, nullptr);
+    }
+
+    //the source allocations now own the new memory, the old memory is released
+    VkResult result = vmaEndDefragmentationPass(inst.allocator, context, &passInfo);
+
+    for (relocation& r : relocations) {
+        if (r.res.buffer != nullptr) {
+            vmaGetAllocationInfo(inst.allocator, r.alloc, &r.res.buffer->allocInfo);
+        } else {
+            vmaGetAllocationInfo(inst.allocator, r.alloc, &r.res.image->allocInfo);
+        }
+    }
+
+    relocations.clear();
+    passActive = false;
+    swapped = false;
+    copies = instance::svkfuture();
+
+    if (result == VK_SUCCESS)
+        endDefragmentation();
+}
+
+void defragmenter::endDefragmentation()
+{
+    VmaDefragmentationStats defragStats{};
+    vmaEndDefragmentation(inst.allocator, context, &defragStats);
+    context = VK_NULL_HANDLE;
+
+    stats.allocationsMoved += defragStats.allocationsMoved;
+    stats.bytesMoved += defragStats.bytesMoved;
+    stats.bytesFreed += defragStats.bytesFreed;
+    stats.deviceMemoryBlocksFreed += defragStats.deviceMemoryBlocksFreed;
+
+    if (!pendingPools.empty()) {
+        VmaPool pool = pendingPools.back();
+        pendingPools.pop_back();
+        beginDefragmentation(pool);
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_DEFRAG_CPP
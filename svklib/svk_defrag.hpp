@@ -0,0 +1,127 @@
+#ifndef SVKLIB_DEFRAG_HPP
+#define SVKLIB_DEFRAG_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//incremental defragmentation on top of vma, a bounded number of moves per pass and one step per frame
+//a pass copies the moved resources into new ones and swaps the registered handles once the copy is done,
+//descriptor sets of each frame slot are rewritten when that slot's fence has signaled,
+//the old memory is released after every frame slot has been rewritten
+//only registered resources are moved, they must be read only after their upload (textures, geometry)
+//and neither written through their mapping nor destroyed without unregistering them first
+class defragmenter {
+public:
+    defragmenter(instance& inst, uint32_t framesInFlight, uint32_t maxMovesPerPass = 16, VkDeviceSize maxBytesPerPass = 64 * 1024 * 1024);
+    ~defragmenter(); //finishes the running pass
+    defragmenter(const defragmenter&) = delete;
+    defragmenter& operator=(const defragmenter&) = delete;
+
+    static constexpr uint32_t allFrames = UINT32_MAX;
+
+    //createInfo is what the resource was created with, the replacement is created the same way
+    void registerBuffer(instance::svkbuffer* buffer, VkBufferCreateInfo createInfo);
+    //layout the image is kept in, view settings are used to recreate image->view if it has one
+    void registerImage(instance::svkimage* image, VkImageCreateInfo createInfo, VkImageLayout layout,
+                       VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D, VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
+    //calls finish() if the running pass is moving the resource
+    void unregisterBuffer(instance::svkbuffer* buffer);
+    void unregisterImage(instance::svkimage* image);
+
+    //descriptors rewritten when their resource moves, frame is the frame slot using the set
+    //sets shared by every frame (allFrames) cost a graphics queue waitIdle when they have to be rewritten
+    void registerDescriptor(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+                            instance::svkbuffer* buffer, VkDeviceSize offset, VkDeviceSize range, uint32_t frame);
+    void registerDescriptor(VkDescriptorSet set, uint32_t binding, uint32_t arrayElement, VkDescriptorType type,
+                            instance::svkimage* image, VkImageLayout layout, uint32_t frame);
+    void unregisterDescriptors(VkDescriptorSet set);
+
+    //called with the svkbuffer*/svkimage* right after its handles were swapped, for raw copies of them
+    //(graphics::pipeline::vertexBuffers, renderer::invalidateCommandBuffers for replayed command buffers)
+    std::function<void(void* resource)> onRelocate = nullptr;
+
+    //starts a defragmentation run, passes are made by step() until vma finds nothing left to move
+    void start();
+    inline bool running() const { return context != VK_NULL_HANDLE; }
+    //call once per frame right after the fence of frame has signaled, before recording it
+    //returns true when handles or descriptor sets changed, command buffers that bound them must be re-recorded
+    bool step(uint32_t frame);
+    //blocking, waits for the graphics queue, completes the running pass and ends the run
+    void finish();
+
+    struct statistics {
+        uint64_t passes = 0;
+        uint64_t allocationsMoved = 0;
+        uint64_t bytesMoved = 0;
+        uint64_t bytesFreed = 0;
+        uint64_t deviceMemoryBlocksFreed = 0;
+    };
+    inline statistics getStatistics() const { return stats; }
+
+private:
+    instance& inst;
+    const uint32_t framesInFlight;
+    const uint32_t maxMovesPerPass;
+    const VkDeviceSize maxBytesPerPass;
+
+    struct resource {
+        instance::svkbuffer* buffer = nullptr;
+        instance::svkimage* image = nullptr;
+        VkBufferCreateInfo bufferInfo{};
+        VkImageCreateInfo imageInfo{};
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
+        VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT;
+    };
+    struct descriptor {
+        VkDescriptorSet set;
+        uint32_t binding;
+        uint32_t arrayElement;
+        VkDescriptorType type;
+        void* resource; //svkbuffer* or svkimage*
+        VkDeviceSize offset;
+        VkDeviceSize range;
+        VkImageLayout layout;
+        uint32_t frame;
+    };
+    struct relocation {
+        VmaAllocation alloc;
+        resource res;
+        VkBuffer oldBuffer = VK_NULL_HANDLE;
+        VkBuffer newBuffer = VK_NULL_HANDLE;
+        VkImage oldImage = VK_NULL_HANDLE;
+        VkImage newImage = VK_NULL_HANDLE;
+        std::optional<VkImageView> oldView;
+        std::optional<VkImageView> newView;
+    };
+
+    std::recursive_mutex mutex;
+    std::unordered_map<VmaAllocation,resource> resources;
+    std::vector<descriptor> descriptors;
+
+    VmaDefragmentationContext context = VK_NULL_HANDLE;
+    std::vector<VmaPool> pendingPools; //still to be defragmented in this run
+    bool passActive = false;
+    VmaDefragmentationPassMoveInfo passInfo{};
+    std::vector<relocation> relocations;
+    instance::svkfuture copies;
+    bool swapped = false;
+    std::vector<bool> slotsRewritten;
+    statistics stats;
+
+    void beginDefragmentation(VmaPool pool);
+    void beginPass();
+    void recordCopies(VkCommandBuffer commandBuffer);
+    void swapHandles();
+    void rewriteDescriptors(uint32_t frame);
+    void endPass();
+    void endDefragmentation();
+    bool isMoving(VmaAllocation alloc);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_DEFRAG_HPP
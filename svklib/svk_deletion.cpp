@@ -0,0 +1,151 @@
+#ifndef SVKLIB_DELETION_CPP
+#define SVKLIB_DELETION_CPP
+
+#include "svk_deletion.hpp"
+
+namespace svklib {
+
+deletion_queue::deletion_queue(instance& inst)
+    : inst(inst)
+{}
+
+deletion_queue::~deletion_queue()
+{
+    flush();
+}
+
+void deletion_queue::defer(std::function<void()> destroy)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    frameEntries.push_back({frame, VK_NULL_HANDLE, std::move(destroy)});
+}
+
+void deletion_queue::destroyBuffer(instance::svkbuffer buffer)
+{
+    defer([this, buffer]() mutable { inst.destroyBuffer(buffer); });
+}
+
+void deletion_queue::destroyImage(instance::svkimage image)
+{
+    defer([this, image]() mutable { inst.destroyImage(image); });
+}
+
+void deletion_queue::destroyImageView(VkImageView imageView)
+{
+    defer([this, imageView]() { inst.destroyImageView(imageView); });
+}
+
+void deletion_queue::destroySampler(VkSampler sampler)
+{
+    defer([this, sampler]() { inst.destroySampler(sampler); });
+}
+
+void deletion_queue::destroyBuffer(instance::bufferHandle buffer)
+{
+    defer([this, buffer]() { inst.destroyBuffer(buffer); });
+}
+
+void deletion_queue::destroyImage(instance::imageHandle image)
+{
+    defer([this, image]() { inst.destroyImage(image); });
+}
+
+void deletion_queue::defer(std::function<void()> destroy, VkSemaphore timeline, uint64_t value)
+{
+    if (!inst.hasTimelineSemaphores()) {
+        throw std::runtime_error("timeline semaphores are not supported (requires Vulkan 1.2)");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    timelineEntries.push_back({value, timeline, std::move(destroy)});
+}
+
+void deletion_queue::destroyBuffer(instance::svkbuffer buffer, VkSemaphore timeline, uint64_t value)
+{
+    defer([this, buffer]() mutable { inst.destroyBuffer(buffer); }, timeline, value);
+}
+
+void deletion_queue::destroyImage(instance::svkimage image, VkSemaphore timeline, uint64_t value)
+{
+    defer([this, image]() mutable { inst.destroyImage(image); }, timeline, value);
+}
+
+void deletion_queue::beginFrame(uint64_t frame, uint32_t framesInFlight)
+{
+    std::vector<std::function<void()>> destroys;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->frame = frame;
+        if (frame >= framesInFlight) {
+            const uint64_t completed = frame - framesInFlight;
+            while (!frameEntries.empty() && frameEntries.front().key <= completed) {
+                destroys.push_back(std::move(frameEntries.front().destroy));
+                frameEntries.pop_front();
+            }
+        }
+    }
+    run(destroys);
+    collect();
+}
+
+void deletion_queue::collect()
+{
+    std::vector<std::function<void()>> destroys;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        //one query per semaphore
+        std::unordered_map<VkSemaphore,uint64_t> values;
+        std::erase_if(timelineEntries, [&](entry& e) {
+            auto it = values.find(e.timeline);
+            if (it == values.end()) {
+                uint64_t value = 0;
+                vkGetSemaphoreCounterValue(inst.device, e.timeline, &value);
+                it = values.emplace(e.timeline, value).first;
+            }
+            if (it->second < e.key)
+                return false;
+            destroys.push_back(std::move(e.destroy));
+            return true;
+        });
+    }
+    run(destroys);
+}
+
+void deletion_queue::flush()
+{
+    inst.waitForDeviceIdle();
+    //destroy functions may queue more entries
+    for (;;) {
+        std::vector<std::function<void()>> destroys;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (entry& e : frameEntries) {
+                destroys.push_back(std::move(e.destroy));
+            }
+            for (entry& e : timelineEntries) {
+                destroys.push_back(std::move(e.destroy));
+            }
+            frameEntries.clear();
+            timelineEntries.clear();
+        }
+        if (destroys.empty())
+            break;
+        run(destroys);
+    }
+}
+
+size_t deletion_queue::pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return frameEntries.size() + timelineEntries.size();
+}
+
+void deletion_queue::run(std::vector<std::function<void()>>& destroys)
+{
+    for (auto& destroy : destroys) {
+        destroy();
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_DELETION_CPP
@@ -0,0 +1,66 @@
+#ifndef SVKLIB_DELETION_HPP
+#define SVKLIB_DELETION_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//resources released while the gpu may still use them, destroyed once it no longer can
+//frame keyed entries are tagged with the frame being recorded and destroyed when the renderer
+//reports that frame complete, timeline keyed entries when the semaphore reaches their value
+//without a renderer calling beginFrame, frame keyed entries wait for flush() or the destructor
+class deletion_queue {
+public:
+    deletion_queue(instance& inst);
+    ~deletion_queue(); //waits for the device, then destroys everything still queued
+    deletion_queue(const deletion_queue&) = delete;
+    deletion_queue& operator=(const deletion_queue&) = delete;
+
+    //thread safe, destroyed once the frame being recorded has completed
+    void destroyBuffer(instance::svkbuffer buffer);
+    void destroyImage(instance::svkimage image);
+    void destroyImageView(VkImageView imageView);
+    void destroySampler(VkSampler sampler);
+    //the handle stays valid until it is destroyed
+    void destroyBuffer(instance::bufferHandle buffer);
+    void destroyImage(instance::imageHandle image);
+    void defer(std::function<void()> destroy);
+
+    //thread safe, destroyed once timeline has reached value (requires timeline semaphores)
+    void destroyBuffer(instance::svkbuffer buffer, VkSemaphore timeline, uint64_t value);
+    void destroyImage(instance::svkimage image, VkSemaphore timeline, uint64_t value);
+    void defer(std::function<void()> destroy, VkSemaphore timeline, uint64_t value);
+
+    //called by the renderer once the fence of the frame slot has signaled, frame counts submitted frames
+    //frames up to frame - framesInFlight are complete, what they released is destroyed
+    void beginFrame(uint64_t frame, uint32_t framesInFlight);
+    //non blocking, destroys the timeline keyed entries that have been reached
+    void collect();
+    //blocking, waits for the device and destroys everything
+    void flush();
+
+    size_t pending();
+
+private:
+    instance& inst;
+
+    struct entry {
+        uint64_t key; //frame or timeline value
+        VkSemaphore timeline; //VK_NULL_HANDLE for frame keyed entries
+        std::function<void()> destroy;
+    };
+
+    std::mutex mutex;
+    uint64_t frame = 0; //frame being recorded
+    std::deque<entry> frameEntries; //keys never decrease
+    std::vector<entry> timelineEntries;
+
+    //runs unlocked, destroy functions may queue more entries
+    static void run(std::vector<std::function<void()>>& destroys);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_DELETION_HPP
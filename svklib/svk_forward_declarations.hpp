@@ -15,6 +15,20 @@ namespace descriptor {
 class threadpool;
 
 class instance;
+class staging_ring;
+class upload_batch;
+class range_allocator;
+class geometry_heap;
+class frame_allocator;
+class defragmenter;
+class memory_pools;
+class deletion_queue;
+class transient_attachments;
+class handle_slots;
+class bcn_encoder;
+class mip_generator;
+class texture_cache;
+class texture_loader;
 class swapchain;
 
 namespace graphics {
@@ -24,6 +38,9 @@ namespace graphics {
         VkDeviceSize offset;
         uint32_t count;
         VkIndexType type;
+        //where the draw starts inside a shared buffer (geometry_heap)
+        uint32_t firstIndex = 0;
+        int32_t vertexOffset = 0;
     };
 }
 
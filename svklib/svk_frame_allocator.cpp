@@ -0,0 +1,92 @@
+#ifndef SVKLIB_FRAME_ALLOCATOR_CPP
+#define SVKLIB_FRAME_ALLOCATOR_CPP
+
+#include "svk_frame_allocator.hpp"
+
+namespace svklib {
+
+frame_allocator::frame_allocator(instance& inst, uint32_t framesInFlight, VkDeviceSize sizePerFrame)
+    : inst(inst), framesInFlight(framesInFlight), sizePerFrame(sizePerFrame)
+{
+    const VkPhysicalDeviceProperties properties = inst.getPhysicalDeviceProperties();
+    uniformAlignment = properties.limits.minUniformBufferOffsetAlignment;
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizePerFrame * framesInFlight;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    buffer = inst.createBuffer(bufferInfo,allocInfo,bufferInfo.size);
+    if (buffer.allocInfo.pMappedData == nullptr) {
+        throw std::runtime_error("failed to map frame allocator!");
+    }
+}
+
+frame_allocator::~frame_allocator()
+{
+    inst.destroyBuffer(buffer);
+}
+
+void frame_allocator::reset(uint32_t frame)
+{
+    if (frame >= framesInFlight) {
+        throw std::runtime_error("frame slot out of range (frame_allocator)");
+    }
+    this->frame = frame;
+    head.store(0,std::memory_order_relaxed);
+}
+
+frame_allocator::allocation frame_allocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    if (alignment == 0)
+        alignment = 1;
+
+    //the region starts at a multiple of sizePerFrame, offsets are aligned relative to the whole buffer
+    const VkDeviceSize base = static_cast<VkDeviceSize>(frame) * sizePerFrame;
+
+    VkDeviceSize offset;
+    VkDeviceSize current = head.load(std::memory_order_relaxed);
+    do {
+        offset = (base + current + alignment - 1) / alignment * alignment - base;
+        if (offset + size > sizePerFrame) {
+            throw std::runtime_error("frame allocator is out of memory!");
+        }
+    } while (!head.compare_exchange_weak(current, offset + size, std::memory_order_relaxed));
+
+    allocation alloc{};
+    alloc.buffer = buffer.buff;
+    alloc.offset = base + offset;
+    alloc.size = size;
+    alloc.mapped = static_cast<char*>(buffer.allocInfo.pMappedData) + base + offset;
+    return alloc;
+}
+
+frame_allocator::allocation frame_allocator::allocateUniform(VkDeviceSize size)
+{
+    return allocate(size, uniformAlignment);
+}
+
+void frame_allocator::flush()
+{
+    const VkDeviceSize used = head.load(std::memory_order_relaxed);
+    if (used > 0)
+        vmaFlushAllocation(inst.allocator, buffer.alloc, static_cast<VkDeviceSize>(frame) * sizePerFrame, used);
+}
+
+VkDescriptorBufferInfo frame_allocator::getDynamicBufferInfo(VkDeviceSize range)
+{
+    VkDescriptorBufferInfo bufferInfo;
+    bufferInfo.buffer = buffer.buff;
+    bufferInfo.offset = 0;
+    bufferInfo.range = range;
+    return bufferInfo;
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_FRAME_ALLOCATOR_CPP
@@ -0,0 +1,61 @@
+#ifndef SVKLIB_FRAME_ALLOCATOR_HPP
+#define SVKLIB_FRAME_ALLOCATOR_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//linear allocator for data that lives for one frame (uniforms, dynamic vertices/indices)
+//one persistently mapped buffer split into a region per frame in flight, so a single
+//UNIFORM_BUFFER_DYNAMIC descriptor covers every frame and objects only differ by dynamic offset
+class frame_allocator {
+public:
+    frame_allocator(instance& inst, uint32_t framesInFlight, VkDeviceSize sizePerFrame);
+    ~frame_allocator();
+    frame_allocator(const frame_allocator&) = delete;
+    frame_allocator& operator=(const frame_allocator&) = delete;
+
+    struct allocation {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0; //from the start of the buffer
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        inline uint32_t dynamicOffset() const { return static_cast<uint32_t>(offset); }
+    };
+
+    //starts writing into the region of frame, only once the fence of that frame has signaled
+    void reset(uint32_t frame);
+    //thread safe, throws when the region of the current frame is full
+    allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+    //aligned to minUniformBufferOffsetAlignment
+    allocation allocateUniform(VkDeviceSize size);
+    template<typename T>
+    allocation pushUniform(const T& value) {
+        allocation alloc = allocateUniform(sizeof(T));
+        memcpy(alloc.mapped, &value, sizeof(T));
+        return alloc;
+    }
+    //makes the writes of the current frame visible, call before submitting it (no-op on coherent memory)
+    void flush();
+
+    inline VkBuffer getBuffer() const { return buffer.buff; }
+    inline uint32_t getFrame() const { return frame; }
+    //descriptor for a UNIFORM_BUFFER_DYNAMIC binding, range is the size one object reads
+    VkDescriptorBufferInfo getDynamicBufferInfo(VkDeviceSize range);
+
+private:
+    instance& inst;
+    const uint32_t framesInFlight;
+    const VkDeviceSize sizePerFrame;
+    VkDeviceSize uniformAlignment;
+    instance::svkbuffer buffer;
+
+    uint32_t frame = 0;
+    std::atomic<VkDeviceSize> head{0}; //offset inside the current frame's region
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_FRAME_ALLOCATOR_HPP
@@ -0,0 +1,234 @@
+#ifndef SVKLIB_GEOMETRY_CPP
+#define SVKLIB_GEOMETRY_CPP
+
+#include "svk_geometry.hpp"
+
+#include "svk_upload.hpp"
+#include "svk_memory.hpp"
+
+namespace svklib {
+
+//range_allocator
+range_allocator::range_allocator(VkDeviceSize capacity)
+    : capacity(capacity), free(capacity)
+{
+    if (capacity > 0)
+        ranges[0] = capacity;
+}
+
+bool range_allocator::allocate(VkDeviceSize size, VkDeviceSize& offset)
+{
+    if (size == 0) {
+        offset = 0;
+        return true;
+    }
+
+    for (auto it = ranges.begin(); it != ranges.end(); it++) {
+        if (it->second < size)
+            continue;
+
+        offset = it->first;
+        const VkDeviceSize remaining = it->second - size;
+        ranges.erase(it);
+        if (remaining > 0)
+            ranges[offset + size] = remaining;
+        free -= size;
+        return true;
+    }
+    return false;
+}
+
+void range_allocator::release(VkDeviceSize offset, VkDeviceSize size)
+{
+    if (size == 0)
+        return;
+    if (offset > capacity || size > capacity - offset) {
+        throw std::runtime_error("range_allocator::release out of range");
+    }
+
+    //a double free or a wrong size would overlap a free range and corrupt the list
+    auto next = ranges.lower_bound(offset);
+    if (next != ranges.end() && offset + size > next->first) {
+        throw std::runtime_error("range_allocator::release of a range that is already free");
+    }
+    if (next != ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second > offset) {
+            throw std::runtime_error("range_allocator::release of a range that is already free");
+        }
+    }
+
+    free += size;
+
+    //merge with the following range
+    if (next != ranges.end() && offset + size == next->first) {
+        size += next->second;
+        next = ranges.erase(next);
+    }
+
+    //merge with the preceding range
+    if (next != ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+
+    ranges[offset] = size;
+}
+//range_allocator end
+
+geometry_heap::geometry_heap(instance& inst, uint32_t vertexStride, VkDeviceSize vertexCapacity, VkIndexType indexType, VkDeviceSize indexCapacity)
+    : inst(inst), vertexStride(vertexStride), indexType(indexType),
+      indexSize(indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)),
+      vertexRanges(vertexCapacity), indexRanges(indexCapacity)
+{
+    if (indexType != VK_INDEX_TYPE_UINT16 && indexType != VK_INDEX_TYPE_UINT32) {
+        throw std::runtime_error("Index type not supported");
+    }
+    if (vertexStride == 0 || vertexCapacity == 0 || indexCapacity == 0) {
+        throw std::runtime_error("geometry heap needs a vertex stride and non zero capacities");
+    }
+    //firstIndex is a uint32_t and firstVertex doubles as the int32_t vertexOffset of vkCmdDrawIndexed
+    if (vertexCapacity > static_cast<VkDeviceSize>(INT32_MAX) + 1 || indexCapacity > static_cast<VkDeviceSize>(UINT32_MAX) + 1) {
+        throw std::runtime_error("geometry heap capacity exceeds what a draw can address");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    //uploads on a dedicated transfer queue must not take ownership of ranges that are being drawn from
+    std::array<uint32_t,2> queueFamilies = {inst.getGraphicsFamily(), 0};
+    if (inst.hasDedicatedTransferQueue()) {
+        queueFamilies[1] = inst.getTransferFamily();
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    //host visible when the device allows it (ReBAR/UMA), uploads are then plain memcpys
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    bufferInfo.size = vertexCapacity * vertexStride;
+    bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    vertexBuffer = inst.getMemoryPools().createBuffer(memory_pools::category::geometry,bufferInfo,allocInfo,bufferInfo.size);
+
+    bufferInfo.size = indexCapacity * indexSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    indexBuffer = inst.getMemoryPools().createBuffer(memory_pools::category::geometry,bufferInfo,allocInfo,bufferInfo.size);
+
+    concurrent = bufferInfo.sharingMode == VK_SHARING_MODE_CONCURRENT;
+}
+
+geometry_heap::~geometry_heap()
+{
+    inst.destroyBuffer(vertexBuffer);
+    inst.destroyBuffer(indexBuffer);
+}
+
+geometry_heap::mesh geometry_heap::allocate(uint32_t vertexCount, uint32_t indexCount)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    releaseFrees(false);
+
+    VkDeviceSize firstVertex, firstIndex;
+    for (;;) {
+        const bool vertexFit = vertexRanges.allocate(vertexCount,firstVertex);
+        if (vertexFit && indexRanges.allocate(indexCount,firstIndex))
+            break;
+        if (vertexFit)
+            vertexRanges.release(firstVertex,vertexCount);
+
+        //frees the gpu has not finished with yet may make room
+        if (pendingFrees.empty()) {
+            throw std::runtime_error(vertexFit ? "geometry heap is out of index space!" : "geometry heap is out of vertex space!");
+        }
+        releaseFrees(true);
+    }
+
+    //both fit, the capacities are checked in the constructor
+    mesh m{};
+    m.firstVertex = static_cast<uint32_t>(firstVertex);
+    m.vertexCount = vertexCount;
+    m.firstIndex = static_cast<uint32_t>(firstIndex);
+    m.indexCount = indexCount;
+    return m;
+}
+
+void geometry_heap::free(const mesh& m)
+{
+    //frames already submitted may still draw it, the ranges are handed out (and possibly written directly) again once they completed
+    instance::svkfuture submitted = inst.fenceGraphicsQueue();
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingFrees.push_back({submitted,m});
+}
+
+void geometry_heap::releaseFrees(bool block)
+{
+    while (!pendingFrees.empty()) {
+        pendingFree& oldest = pendingFrees.front();
+        if (block) {
+            oldest.submitted.wait();
+            block = false;
+        } else if (!oldest.submitted.ready()) {
+            return;
+        }
+        vertexRanges.release(oldest.m.firstVertex,oldest.m.vertexCount);
+        indexRanges.release(oldest.m.firstIndex,oldest.m.indexCount);
+        pendingFrees.pop_front();
+    }
+}
+
+geometry_heap::mesh geometry_heap::upload(upload_batch& batch, const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount)
+{
+    mesh m = allocate(vertexCount,indexCount);
+    const VkDeviceSize vertexOffset = static_cast<VkDeviceSize>(m.firstVertex) * vertexStride;
+    const VkDeviceSize indexOffset = static_cast<VkDeviceSize>(m.firstIndex) * indexSize;
+    const VkDeviceSize vertexBytes = static_cast<VkDeviceSize>(vertexCount) * vertexStride;
+    const VkDeviceSize indexBytes = static_cast<VkDeviceSize>(indexCount) * indexSize;
+    if (!inst.writeBufferDirect(vertexBuffer,vertexOffset,vertices,vertexBytes))
+        batch.addBufferCopy(vertexBuffer.buff,vertexOffset,vertices,vertexBytes,VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,concurrent);
+    if (!inst.writeBufferDirect(indexBuffer,indexOffset,indices,indexBytes))
+        batch.addBufferCopy(indexBuffer.buff,indexOffset,indices,indexBytes,VK_BUFFER_USAGE_INDEX_BUFFER_BIT,concurrent);
+    return m;
+}
+
+geometry_heap::mesh geometry_heap::upload(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount)
+{
+    upload_batch batch(inst);
+    mesh m = upload(batch,vertices,vertexCount,indices,indexCount);
+    batch.submit().wait();
+    return m;
+}
+
+graphics::IndexBufferInfo geometry_heap::getIndexBufferInfo(const mesh& m) const
+{
+    graphics::IndexBufferInfo indexBufferInfo;
+    indexBufferInfo.buff = indexBuffer.buff;
+    indexBufferInfo.offset = 0;
+    indexBufferInfo.count = m.indexCount;
+    indexBufferInfo.type = indexType;
+    indexBufferInfo.firstIndex = m.firstIndex;
+    indexBufferInfo.vertexOffset = static_cast<int32_t>(m.firstVertex);
+    return indexBufferInfo;
+}
+
+void geometry_heap::bind(VkCommandBuffer commandBuffer, uint32_t vertexBinding)
+{
+    const VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, vertexBinding, 1, &vertexBuffer.buff, &offset);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buff, 0, indexType);
+}
+
+void geometry_heap::draw(VkCommandBuffer commandBuffer, const mesh& m, uint32_t instanceCount, uint32_t firstInstance)
+{
+    vkCmdDrawIndexed(commandBuffer, m.indexCount, instanceCount, m.firstIndex, static_cast<int32_t>(m.firstVertex), firstInstance);
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_GEOMETRY_CPP
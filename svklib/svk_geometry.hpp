@@ -0,0 +1,94 @@
+#ifndef SVKLIB_GEOMETRY_HPP
+#define SVKLIB_GEOMETRY_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//first fit free list over [0, capacity), neighbouring free ranges are merged on release
+class range_allocator {
+public:
+    range_allocator() = default;
+    range_allocator(VkDeviceSize capacity);
+
+    //returns false when no free range is large enough
+    bool allocate(VkDeviceSize size, VkDeviceSize& offset);
+    //throws on ranges outside the capacity or overlapping a free range (double free)
+    void release(VkDeviceSize offset, VkDeviceSize size);
+
+    inline VkDeviceSize getCapacity() const { return capacity; }
+    inline VkDeviceSize getFree() const { return free; }
+
+private:
+    VkDeviceSize capacity = 0;
+    VkDeviceSize free = 0;
+    std::map<VkDeviceSize,VkDeviceSize> ranges; //offset -> size, sorted by offset
+};
+
+//one device local vertex buffer and one index buffer shared by every mesh
+//meshes are addressed by firstIndex/vertexOffset so all of them draw from a single bind
+class geometry_heap {
+public:
+    //capacities in vertices and indices, at most 2^31 vertices so any firstVertex is a valid vertexOffset
+    geometry_heap(instance& inst, uint32_t vertexStride, VkDeviceSize vertexCapacity, VkIndexType indexType, VkDeviceSize indexCapacity);
+    ~geometry_heap();
+    geometry_heap(const geometry_heap&) = delete;
+    geometry_heap& operator=(const geometry_heap&) = delete;
+
+    //ranges are in vertices and indices, not bytes
+    struct mesh {
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+
+    //throws when the heap is full, waits for pending frees first
+    mesh allocate(uint32_t vertexCount, uint32_t indexCount);
+    //frames submitted before the call may still draw the mesh, its ranges are reused once they completed,
+    //so uploads never write memory in use, later frames must not record it anymore
+    void free(const mesh& m);
+
+    //queues the copies on the batch, the mesh is drawable once the batch has completed
+    //ranges are never in use when allocated, so host visible heaps (ReBAR/UMA) are written directly
+    mesh upload(upload_batch& batch, const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount);
+    //blocking
+    mesh upload(const void* vertices, uint32_t vertexCount, const void* indices, uint32_t indexCount);
+
+    inline VkBuffer getVertexBuffer() const { return vertexBuffer.buff; }
+    inline VkBuffer getIndexBuffer() const { return indexBuffer.buff; }
+    //for graphics::pipeline::indexBufferInfo, bind getVertexBuffer() at offset 0 alongside it
+    graphics::IndexBufferInfo getIndexBufferInfo(const mesh& m) const;
+
+    //binds both buffers once, then any number of draw() calls
+    void bind(VkCommandBuffer commandBuffer, uint32_t vertexBinding = 0);
+    void draw(VkCommandBuffer commandBuffer, const mesh& m, uint32_t instanceCount = 1, uint32_t firstInstance = 0);
+
+private:
+    instance& inst;
+    const uint32_t vertexStride;
+    const VkIndexType indexType;
+    const uint32_t indexSize;
+
+    instance::svkbuffer vertexBuffer;
+    instance::svkbuffer indexBuffer;
+    bool concurrent = false;
+
+    std::mutex mutex;
+    range_allocator vertexRanges;
+    range_allocator indexRanges;
+
+    struct pendingFree {
+        instance::svkfuture submitted; //covers every graphics submission made before free()
+        mesh m;
+    };
+    std::deque<pendingFree> pendingFrees; //oldest first
+    //returns the ranges of completed frees, block waits for at least the oldest, expects mutex held
+    void releaseFrees(bool block);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_GEOMETRY_HPP
@@ -0,0 +1,70 @@
+#ifndef SVKLIB_HANDLES_CPP
+#define SVKLIB_HANDLES_CPP
+
+#include "svk_handles.hpp"
+
+namespace svklib {
+
+handle_slots::handle_slots(uint32_t capacity)
+    : capacity(capacity)
+{
+    if (capacity == 0 || capacity > handle<void>::indexMask + 1) {
+        throw std::runtime_error("handle pool capacity out of range!");
+    }
+}
+
+uint32_t handle_slots::allocate()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t index;
+    if (!freeList.empty()) {
+        index = freeList.back();
+        freeList.pop_back();
+    } else {
+        //lowest index handed out first, pages only get created once they are reached
+        if (used == capacity) {
+            throw std::runtime_error("handle pool is full!");
+        }
+        index = used++;
+        generations.reserve(index);
+        nextGeneration.reserve(index);
+        nextGeneration[index] = 1;
+    }
+
+    const uint16_t generation = nextGeneration[index];
+    generations[index].store(generation, std::memory_order_release);
+    //the caller writes the slot fields next, readers of an older handle must see the new generation first
+    std::atomic_thread_fence(std::memory_order_release);
+    return (static_cast<uint32_t>(generation) << handle<void>::indexBits) | index;
+}
+
+void handle_slots::release(uint32_t value)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!valid(value)) {
+        throw std::runtime_error("released a stale handle!");
+    }
+    const uint32_t index = value & handle<void>::indexMask;
+    generations[index].store(0, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_release);
+    //generation 0 marks free slots, skip it when wrapping
+    uint16_t generation = static_cast<uint16_t>((nextGeneration[index] + 1) & handle<void>::generationMask);
+    nextGeneration[index] = generation == 0 ? 1 : generation;
+    freeList.push_back(index);
+}
+
+std::vector<uint32_t> handle_slots::live()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> values;
+    for (uint32_t i = 0; i < used; i++) {
+        const uint16_t generation = generations[i].load(std::memory_order_relaxed);
+        if (generation != 0)
+            values.push_back((static_cast<uint32_t>(generation) << handle<void>::indexBits) | i);
+    }
+    return values;
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_HANDLES_CPP
@@ -0,0 +1,109 @@
+#ifndef SVKLIB_HANDLES_HPP
+#define SVKLIB_HANDLES_HPP
+
+#include "svk_forward_declarations.hpp"
+
+namespace svklib {
+
+//32 bit generational handle, slot index in the low bits and generation in the high bits
+//0 is the null handle, a handle goes stale when its slot is released
+template<typename Tag>
+struct handle {
+    static constexpr uint32_t indexBits = 20;
+    static constexpr uint32_t indexMask = (1u << indexBits) - 1;
+    static constexpr uint32_t generationMask = (1u << (32 - indexBits)) - 1;
+
+    uint32_t value = 0;
+
+    inline uint32_t index() const { return value & indexMask; }
+    inline uint32_t generation() const { return value >> indexBits; }
+    inline explicit operator bool() const { return value != 0; }
+    bool operator==(const handle&) const = default;
+};
+
+//per slot storage in fixed size pages allocated on first use, so memory grows with the number
+//of slots ever used while nothing already stored moves and lookups need no lock
+template<typename T>
+class handle_table {
+public:
+    static constexpr uint32_t pageBits = 10;
+    static constexpr uint32_t pageSize = 1u << pageBits;
+    static constexpr uint32_t pageCount = (handle<void>::indexMask + 1) >> pageBits;
+
+    handle_table() = default;
+    ~handle_table() {
+        for (std::atomic<T*>& page : pages)
+            delete[] page.load(std::memory_order_relaxed);
+    }
+    handle_table(const handle_table&) = delete;
+    handle_table& operator=(const handle_table&) = delete;
+
+    //thread safe, value initializes the page of index if it does not exist yet
+    void reserve(uint32_t index) {
+        std::atomic<T*>& page = pages[index >> pageBits];
+        if (page.load(std::memory_order_acquire) != nullptr)
+            return;
+        T* created = new T[pageSize]();
+        T* expected = nullptr;
+        if (!page.compare_exchange_strong(expected, created, std::memory_order_acq_rel))
+            delete[] created; //another thread was first
+    }
+    //nullptr when the page of index was never reserved
+    inline T* find(uint32_t index) const {
+        T* page = pages[index >> pageBits].load(std::memory_order_acquire);
+        return page != nullptr ? page + (index & (pageSize - 1)) : nullptr;
+    }
+    //the page of index must have been reserved
+    inline T& operator[](uint32_t index) const {
+        return *find(index);
+    }
+
+private:
+    std::array<std::atomic<T*>,pageCount> pages{};
+};
+
+//free list and generations of a pool of up to capacity slots, the fields of the slots live in
+//handle_tables owned by the user of the slots, indexed by handle::index()
+class handle_slots {
+public:
+    handle_slots(uint32_t capacity = handle<void>::indexMask + 1);
+    handle_slots(const handle_slots&) = delete;
+    handle_slots& operator=(const handle_slots&) = delete;
+
+    //thread safe, throws when every slot is in use, returns the handle value
+    //the caller reserves the index in its tables and fills them before handing the value out
+    uint32_t allocate();
+    //thread safe, bumps the generation so outstanding handles go stale
+    void release(uint32_t value);
+    //one load, safe from any thread
+    inline bool valid(uint32_t value) const {
+        const std::atomic<uint16_t>* generation = generations.find(value & handle<void>::indexMask);
+        return value != 0 && generation != nullptr &&
+               generation->load(std::memory_order_acquire) == (value >> handle<void>::indexBits);
+    }
+    //copies the fields of the slot through copy and checks the generation again afterwards,
+    //so a release (and reuse of the slot) racing with the copy is reported as stale
+    template<typename F>
+    bool read(uint32_t value, F&& copy) const {
+        if (!valid(value))
+            return false;
+        copy();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return valid(value);
+    }
+    //every live handle value, for teardown
+    std::vector<uint32_t> live();
+
+    const uint32_t capacity;
+
+private:
+    handle_table<std::atomic<uint16_t>> generations; //0 while the slot is free
+    handle_table<uint16_t> nextGeneration;
+    uint32_t used = 0; //slots handed out at least once, the rest has no pages yet
+    std::vector<uint32_t> freeList;
+    std::mutex mutex;
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_HANDLES_HPP
@@ -6,6 +6,10 @@
 #include "svk_window.hpp"
 #include "svk_descriptor.hpp"
 #include "svk_threadpool.hpp"
+#include "svk_staging.hpp"
+#include "svk_memory.hpp"
+#include "svk_deletion.hpp"
+#include "svk_texture.hpp"
 
 #include "svk_shader.hpp"
 
@@ -26,22 +30,46 @@ static inline const char* const validationLayers[] = {
     "VK_LAYER_KHRONOS_validation"
 };
 
+static std::atomic<uint64_t> nextInstanceId = 1;
+
 instance::instance(window &win,uint32_t apiVersion)
-    : win(win),apiVersion(apiVersion),
+    : win(&win),apiVersion(apiVersion),instanceId(nextInstanceId++),
     requestedFeatures(nullptr)
 {
     init();
 }
 
 instance::instance(window &win,uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures)
-    :win(win),apiVersion(apiVersion),
+    :win(&win),apiVersion(apiVersion),instanceId(nextInstanceId++),
     requestedFeatures(std::make_unique<VkPhysicalDeviceFeatures>(enabledFeatures))
 {
     init();
 }
 
 instance::instance(window &win,uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures,std::vector<const char*> extensions)
-    :win(win),apiVersion(apiVersion),
+    :win(&win),apiVersion(apiVersion),instanceId(nextInstanceId++),
+    requestedFeatures(std::make_unique<VkPhysicalDeviceFeatures>(enabledFeatures)),
+    requestedExtensions(extensions)
+{
+    init();
+}
+
+instance::instance(uint32_t apiVersion)
+    : win(nullptr),apiVersion(apiVersion),instanceId(nextInstanceId++),
+    requestedFeatures(nullptr)
+{
+    init();
+}
+
+instance::instance(uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures)
+    :win(nullptr),apiVersion(apiVersion),instanceId(nextInstanceId++),
+    requestedFeatures(std::make_unique<VkPhysicalDeviceFeatures>(enabledFeatures))
+{
+    init();
+}
+
+instance::instance(uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures,std::vector<const char*> extensions)
+    :win(nullptr),apiVersion(apiVersion),instanceId(nextInstanceId++),
     requestedFeatures(std::make_unique<VkPhysicalDeviceFeatures>(enabledFeatures)),
     requestedExtensions(extensions)
 {
@@ -59,16 +87,19 @@ static bool contains_string(const std::vector<const char*>& strings, const char*
 }
 
 void instance::init() {
-    if (!contains_string(requestedExtensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+    if (!isHeadless() && !contains_string(requestedExtensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
         requestedExtensions.push_back(swapchainExtension);
 
     createInstance("svklib","svklib",0,1,apiVersion);
     createDebugMessenger();
-    createSurface();
+    if (!isHeadless())
+        createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
     createAllocator();
-    createCommandPools(std::thread::hardware_concurrency());
+    memoryPools = std::make_unique<memory_pools>(*this);
+    deletionQueue = std::make_unique<deletion_queue>(*this);
+    stagingRing = std::make_unique<staging_ring>(*this, stagingRingSize);
     descriptorAllocator = descriptor::allocator::init(device);
     descriptorLayoutCache.init(device);
     glslang::InitializeProcess();
@@ -76,13 +107,20 @@ void instance::init() {
 }
 
 instance::~instance() {
+    drainFutures();
+    deletionQueue.reset();
+    destroyHandles();
     glslang::FinalizeProcess();
     descriptorLayoutCache.cleanup();
     delete descriptorAllocator;
+    stagingRing.reset();
+    memoryPools.reset();
+    destroyFences();
     destroyCommandPools();
     destroyAllocator();
     destroyLogicalDevice();
-    vkDestroySurfaceKHR(inst, surface, NULL);
+    if (surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(inst, surface, NULL);
     destroyDebugMessenger();
     destroyInstance();
 }
@@ -140,11 +178,16 @@ void instance::destroyInstance() {
 }
 
 std::vector<const char*> instance::getRequiredExtensions() {
-    uint32_t glfwExtensionCount = 0;
-    const char** glfwExtensions;
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    std::vector<const char*> extensions{};
 
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    //headless instances never touch glfw, so no surface extensions are needed
+    if (!isHeadless()) {
+        uint32_t glfwExtensionCount = 0;
+        const char** glfwExtensions;
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     if (enableValidationLayers) {
         extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -244,7 +287,7 @@ void instance::destroyDebugMessenger() {
 
 //VKPHYSICALDEVICE
 void instance::createSurface() {
-    surface = win.createSurface(inst);
+    surface = win->createSurface(inst);
 }
 
 void instance::pickPhysicalDevice() {
@@ -335,18 +378,18 @@ bool instance::isDeviceSuitable(VkPhysicalDevice physicalDevice) {
     bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
 
     bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    if (isHeadless()) {
+        swapChainAdequate = true;
+    } else if (extensionsSupported) {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate;
+    return indices.isComplete(isHeadless()) && extensionsSupported && swapChainAdequate;
 }
 
 instance::QueueFamilyIndices instance::findQueueFamilies(VkPhysicalDevice physicalDevice) {
-    if (queueFamilies.has_value() == true) {
-        return queueFamilies.value();
-    }
+    //queries every time, candidates differ while picking a device, createLogicalDevice keeps the result
     QueueFamilyIndices indices{};
     
     uint32_t queueFamilyCount = 0;
@@ -358,25 +401,41 @@ instance::QueueFamilyIndices instance::findQueueFamilies(VkPhysicalDevice physic
     int i = 0;
     for (const auto& queueFamily : queueFamiliesProperties) {
 
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT ) {
+        if (!indices.graphicsFamily.has_value() && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT ) {
             indices.graphicsFamily = i;
         }
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-        if (presentSupport) {
-            indices.presentFamily = i;
+        //async compute runs next to the graphics queue on hardware with separate compute engines
+        if (!indices.computeFamily.has_value() && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT &&
+            !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            indices.computeFamily = i;
         }
 
-        if (indices.isComplete()) {
-            break;
+        //dedicated transfer families usually map to the copy engines and run alongside graphics
+        if (!indices.transferFamily.has_value() && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT &&
+            !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+            indices.transferFamily = i;
+        }
+
+        if (!isHeadless() && !indices.presentFamily.has_value()) {
+            VkBool32 presentSupport = false;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+            if (presentSupport) {
+                indices.presentFamily = i;
+            }
         }
 
         i++;
     }
 
-    if (indices.isComplete()) {
-        queueFamilies = indices;
+    if (!indices.transferFamily.has_value()) {
+        indices.transferFamily = indices.graphicsFamily;
+    }
+    if (!indices.computeFamily.has_value()) {
+        indices.computeFamily = indices.graphicsFamily;
+    }
+
+    if (indices.isComplete(isHeadless())) {
         return indices;
     } else {
         throw std::runtime_error("failed to find queue families!");
@@ -451,6 +510,13 @@ VkFormat instance::findSupportedFormat(const std::vector<VkFormat> &candidates,
     throw std::runtime_error("failed to find supported format!");
 }
 
+bool instance::supportsFormat(VkFormat format, VkFormatFeatureFlags features)
+{
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+    return (props.optimalTilingFeatures & features) == features;
+}
+
 VkFormat instance::findDepthFormat() {
     return findSupportedFormat(
         {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
@@ -526,59 +592,202 @@ VkResult instance::svkqueue::waitIdle()
 
 //SVKQUEUE CLASS END
 
-void instance::createCommandPools(int count)
+instance::svkqueue& instance::getUploadQueue()
 {
-    commandPools.resize(count);
-    commandPoolBorrowed.resize(count);
-    for (int i = 0; i < count; i++) {
-        commandPools[i] = createCommandPool();
-        commandPoolBorrowed[i] = false;
-    }
+    //never hand out a second wrapper around the graphics queue, they would not share a mutex
+    return dedicatedTransferQueue ? transferQueue : graphicsQueue;
 }
 
-void instance::destroyCommandPools()
+instance::svkqueue& instance::getComputeQueue()
+{
+    return dedicatedComputeQueue ? computeQueue : graphicsQueue;
+}
+
+VkPhysicalDeviceProperties instance::getPhysicalDeviceProperties()
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    return properties;
+}
+
+uint32_t instance::getGraphicsFamily()
+{
+    return queueFamilies->graphicsFamily.value();
+}
+
+uint32_t instance::getComputeFamily()
+{
+    return queueFamilies->computeFamily.value();
+}
+
+uint32_t instance::getTransferFamily()
+{
+    return queueFamilies->transferFamily.value();
+}
+
+uint32_t instance::getQueueFamily(QueueType type)
 {
-    for (int i = 0; i < commandPools.size(); i++) {
-        destroyCommandPool(commandPools[i]);
+    const QueueFamilyIndices& indices = queueFamilies.value();
+    switch (type) {
+        case QueueType::transfer: return indices.transferFamily.value();
+        case QueueType::compute: return indices.computeFamily.value();
+        default: return indices.graphicsFamily.value();
     }
 }
 
-instance::CommandPool instance::borrowCommandPool()
+instance::ThreadCommandPools& instance::getThreadCommandPools()
 {
+    //instance ids are never reused so entries of destroyed instances are never looked up again
+    thread_local std::unordered_map<uint64_t,ThreadCommandPools*> cache;
+    auto it = cache.find(instanceId);
+    if (it != cache.end())
+        return *it->second;
+
     std::lock_guard<std::mutex> lock(commandPoolMutex);
+    threadCommandPools.emplace_back(std::make_unique<ThreadCommandPools>());
+    ThreadCommandPools* pools = threadCommandPools.back().get();
+    cache.emplace(instanceId,pools);
+    return *pools;
+}
 
-    for (int i = 0; i < commandPoolBorrowed.size(); i++) {
-        if (!commandPoolBorrowed[i]) {
-            commandPoolBorrowed[i] = true;
-            return CommandPool(*this,commandPools[i],i);
+instance::ThreadCommandPool* instance::findThreadCommandPool(VkCommandPool commandPool)
+{
+    ThreadCommandPools& local = getThreadCommandPools();
+    for (std::deque<ThreadCommandPool>& pools : local.pools) {
+        for (ThreadCommandPool& entry : pools) {
+            if (entry.pool == commandPool)
+                return &entry;
         }
     }
+    return nullptr;
+}
 
-    commandPools.emplace_back(createCommandPool());
-    commandPoolBorrowed.emplace_back(true);
-    return CommandPool(*this,commandPools.back(),commandPools.size()-1);
+void instance::recycleRetiredCommandBuffers(ThreadCommandPool& entry)
+{
+    std::lock_guard<std::mutex> lock(entry.retiredMutex);
+    entry.available.insert(entry.available.end(),entry.retired.begin(),entry.retired.end());
+    entry.retired.clear();
 }
 
-void instance::returnCommandPool(int id)
+void instance::destroyCommandPools()
 {
     std::lock_guard<std::mutex> lock(commandPoolMutex);
-    commandPoolBorrowed[id] = false;
-    vkResetCommandPool(device,commandPools[id],0);
+    for (std::unique_ptr<ThreadCommandPools>& local : threadCommandPools) {
+        for (std::deque<ThreadCommandPool>& pools : local->pools) {
+            for (ThreadCommandPool& entry : pools) {
+                destroyCommandPool(entry.pool);
+            }
+        }
+        for (auto& slot : local->framePools) {
+            for (FrameCommandPool& framePool : slot) {
+                if (framePool.pool.load() != VK_NULL_HANDLE)
+                    destroyCommandPool(framePool.pool.load());
+            }
+        }
+    }
+    threadCommandPools.clear();
+}
+
+instance::CommandPool instance::borrowCommandPool(QueueType type)
+{
+    std::deque<ThreadCommandPool>& pools = getThreadCommandPools().pools[(int)type];
+
+    //only this thread borrows from its own list, others can only set borrowed back to false
+    for (ThreadCommandPool& entry : pools) {
+        if (!entry.borrowed.load(std::memory_order_acquire)) {
+            entry.borrowed.store(true,std::memory_order_relaxed);
+            recycleRetiredCommandBuffers(entry);
+            return CommandPool(*this,&entry);
+        }
+    }
+
+    //nested borrow on this thread
+    ThreadCommandPool& entry = pools.emplace_back();
+    entry.pool = createCommandPool(getQueueFamily(type));
+    entry.borrowed.store(true,std::memory_order_relaxed);
+    return CommandPool(*this,&entry);
 }
 
 instance::CommandPool instance::getCommandPool()
 {
-    return borrowCommandPool();
+    return borrowCommandPool(QueueType::graphics);
+}
+
+instance::CommandPool instance::getTransferCommandPool()
+{
+    //without a dedicated family the upload queue is the graphics queue
+    return borrowCommandPool(dedicatedTransferQueue ? QueueType::transfer : QueueType::graphics);
+}
+
+instance::CommandPool instance::getComputeCommandPool()
+{
+    return borrowCommandPool(dedicatedComputeQueue ? QueueType::compute : QueueType::graphics);
+}
+
+VkCommandPool instance::getFrameCommandPool(uint32_t frame, QueueType type)
+{
+    if (frame >= maxFrameSlots) {
+        throw std::runtime_error("frame slot out of range (getFrameCommandPool)");
+    }
+
+    std::atomic<VkCommandPool>& slot = getThreadCommandPools().framePools[frame][(int)type].pool;
+    VkCommandPool pool = slot.load(std::memory_order_acquire);
+    if (pool == VK_NULL_HANDLE) {
+        pool = createCommandPool(getQueueFamily(type),VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        slot.store(pool,std::memory_order_release);
+    }
+    return pool;
+}
+
+VkCommandBuffer instance::getFrameCommandBuffer(uint32_t frame, VkCommandBufferLevel level, QueueType type)
+{
+    VkCommandPool pool = getFrameCommandPool(frame,type);
+    FrameCommandPool& framePool = getThreadCommandPools().framePools[frame][(int)type];
+    std::vector<VkCommandBuffer>& commandBuffers = framePool.commandBuffers[level];
+
+    uint32_t index = framePool.used[level].fetch_add(1,std::memory_order_relaxed);
+    if (index < commandBuffers.size())
+        return commandBuffers[index];
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate frame command buffer!");
+    }
+    commandBuffers.push_back(commandBuffer);
+    return commandBuffer;
+}
+
+void instance::resetFrameCommandPools(uint32_t frame)
+{
+    std::lock_guard<std::mutex> lock(commandPoolMutex);
+    for (std::unique_ptr<ThreadCommandPools>& local : threadCommandPools) {
+        for (FrameCommandPool& framePool : local->framePools[frame]) {
+            VkCommandPool pool = framePool.pool.load(std::memory_order_acquire);
+            if (pool != VK_NULL_HANDLE)
+                vkResetCommandPool(device,pool,0);
+            framePool.used[VK_COMMAND_BUFFER_LEVEL_PRIMARY].store(0,std::memory_order_relaxed);
+            framePool.used[VK_COMMAND_BUFFER_LEVEL_SECONDARY].store(0,std::memory_order_relaxed);
+        }
+    }
 }
 
 VkCommandPool instance::createCommandPool()
 {
-    QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+    return createCommandPool(queueFamilies->graphicsFamily.value());
+}
 
+VkCommandPool instance::createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags)
+{
     VkCommandPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+    poolInfo.flags = flags;
 
     VkCommandPool commandPool;
     if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
@@ -678,10 +887,16 @@ int instance::getSupportedFeatureScore(VkPhysicalDevice physicalDevice) {
 }
 
 void instance::createLogicalDevice() {
-    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    //queried once for the picked device, everything else reads it from here
+    queueFamilies = findQueueFamilies(physicalDevice);
+    const QueueFamilyIndices& indices = queueFamilies.value();
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value()};
+    if (indices.presentFamily.has_value())
+        uniqueQueueFamilies.insert(indices.presentFamily.value());
+    uniqueQueueFamilies.insert(indices.transferFamily.value());
+    uniqueQueueFamilies.insert(indices.computeFamily.value());
     
     float queuePriority = 1.0f;
     for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -700,7 +915,48 @@ void instance::createLogicalDevice() {
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
-    createInfo.pEnabledFeatures = requestedFeatures.get();
+    //block compressed textures are enabled whenever the device has them
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    VkPhysicalDeviceFeatures enabledFeatures = requestedFeatures != nullptr ? *requestedFeatures : VkPhysicalDeviceFeatures{};
+    if (supportedFeatures.textureCompressionBC == VK_TRUE) {
+        enabledFeatures.textureCompressionBC = VK_TRUE;
+        textureCompressionBC = true;
+    }
+    createInfo.pEnabledFeatures = &enabledFeatures;
+
+    //timeline semaphores for cross queue sync
+    VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    if (apiVersion >= VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+        if (timelineFeatures.timelineSemaphore == VK_TRUE) {
+            timelineFeatures.pNext = nullptr;
+            createInfo.pNext = &timelineFeatures;
+            timelineSemaphores = true;
+        }
+    }
+
+    //driver reported heap budgets for vma, needs Vulkan 1.1 for vkGetPhysicalDeviceMemoryProperties2
+    if (apiVersion >= VK_API_VERSION_1_1 && deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+        for (const auto& extension : availableExtensions) {
+            if (std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+                memoryBudget = true;
+                break;
+            }
+        }
+        if (memoryBudget && !contains_string(requestedExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+            requestedExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
 
     // createInfo.enabledExtensionCount = 0;
     
@@ -723,7 +979,16 @@ void instance::createLogicalDevice() {
     }
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue.queue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue.queue);
+    if (indices.presentFamily.has_value())
+        vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue.queue);
+
+    dedicatedTransferQueue = indices.transferFamily.value() != indices.graphicsFamily.value();
+    if (dedicatedTransferQueue)
+        vkGetDeviceQueue(device, indices.transferFamily.value(), 0, &transferQueue.queue);
+
+    dedicatedComputeQueue = indices.computeFamily.value() != indices.graphicsFamily.value();
+    if (dedicatedComputeQueue)
+        vkGetDeviceQueue(device, indices.computeFamily.value(), 0, &computeQueue.queue);
 
 }
 
@@ -741,7 +1006,24 @@ void instance::createAllocator() {
     allocatorInfo.device = device;
     allocatorInfo.instance = inst;
 
-    vmaCreateAllocator(&allocatorInfo, &allocator);
+    //the version both the instance and the device support, vma uses the core 1.1+ entry points with it
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    const uint32_t version = std::min(apiVersion, deviceProperties.apiVersion);
+    allocatorInfo.vulkanApiVersion = VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0);
+    if (memoryBudget)
+        allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+
+    //per heap device memory counters of memory_pools
+    VmaDeviceMemoryCallbacks deviceMemoryCallbacks{};
+    deviceMemoryCallbacks.pfnAllocate = memory_pools::deviceMemoryAllocated;
+    deviceMemoryCallbacks.pfnFree = memory_pools::deviceMemoryFreed;
+    deviceMemoryCallbacks.pUserData = this;
+    allocatorInfo.pDeviceMemoryCallbacks = &deviceMemoryCallbacks;
+
+    if (vmaCreateAllocator(&allocatorInfo, &allocator) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create memory allocator!");
+    }
 }
 
 void instance::destroyAllocator() {
@@ -763,6 +1045,14 @@ instance::svkbuffer instance::createComputeBuffer(VkDeviceSize size) {
     bufferCreateInfo.size = size;
     bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
     bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    //shared between the async compute and graphics queues without ownership transfers
+    uint32_t families[] = { getGraphicsFamily(), getComputeFamily() };
+    if (dedicatedComputeQueue) {
+        bufferCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferCreateInfo.queueFamilyIndexCount = 2;
+        bufferCreateInfo.pQueueFamilyIndices = families;
+    }
     
     VmaAllocationCreateInfo allocCreateInfo{};
     allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -781,30 +1071,126 @@ instance::svkbuffer instance::createStagingBuffer(VkDeviceSize size) {
     stageAllocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
     stageAllocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-    return createBuffer(stageBufferInfo,stageAllocInfo,size);
+    return memoryPools->createBuffer(memory_pools::category::staging,stageBufferInfo,stageAllocInfo,size);
 }
 
-inline instance::svkbuffer instance::createBufferStaged(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data,VkCommandPool commandPool) {
-    instance::svkbuffer stageBuffer = createStagingBuffer(size);
+VkAccessFlags instance::bufferUsageAccessMask(VkBufferUsageFlags usage) {
+    VkAccessFlags access = 0;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT) access |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) access |= VK_ACCESS_INDEX_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) access |= VK_ACCESS_UNIFORM_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) access |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    if (usage & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) access |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) access |= VK_ACCESS_TRANSFER_READ_BIT;
+    return access;
+}
 
-    memcpy(stageBuffer.allocInfo.pMappedData,data,size);
+instance::svkbuffer instance::createBufferStaged(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data,VkCommandPool commandPool) {
+    instance::svkbuffer buffer{};
+    createBufferStagedAsync(bufferUsage,size,data,commandPool,buffer).wait();
+    return buffer;
+}
 
+instance::svkbuffer instance::createDeviceBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize size) {
     VkBufferCreateInfo bufferCreateInfo{};
     bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferCreateInfo.size = size;
     bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | bufferUsage;
     bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    
+
+    //device local either way, vma only picks host visible memory when it is also device local (ReBAR/UMA)
     VmaAllocationCreateInfo allocCreateInfo{};
-    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-    
-    instance::svkbuffer buffer = createBuffer(bufferCreateInfo,allocCreateInfo,size);
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    return createBuffer(bufferCreateInfo,allocCreateInfo,size);
+}
 
-    copyBufferToBuffer(commandPool,stageBuffer.buff,buffer.buff,size);
+bool instance::isHostVisible(svkbuffer& buffer) {
+    VkMemoryPropertyFlags memoryProperties;
+    vmaGetAllocationMemoryProperties(allocator,buffer.alloc,&memoryProperties);
+    return (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && buffer.allocInfo.pMappedData != nullptr;
+}
 
-    destroyBuffer(stageBuffer);
+bool instance::writeBufferDirect(svkbuffer& buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    if (!isHostVisible(buffer))
+        return false;
 
-    return buffer;
+    memcpy(static_cast<char*>(buffer.allocInfo.pMappedData) + offset,data,size);
+    //host writes are made visible to the device by the next queue submit
+    vmaFlushAllocation(allocator,buffer.alloc,offset,size);
+    return true;
+}
+
+instance::svkfuture instance::createBufferStagedAsync(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data,VkCommandPool commandPool,instance::svkbuffer& buffer) {
+    buffer = createDeviceBuffer(bufferUsage,size);
+
+    //no copy at all when the cpu can write the destination, the returned future is already complete
+    if (writeBufferDirect(buffer,0,data,size))
+        return svkfuture();
+
+    staging_ring::allocation stage = stagingRing->upload(data,size);
+
+    svkfuture future;
+    if (!dedicatedTransferQueue) {
+        future = copyBufferToBufferAsync(commandPool,stage.buffer,buffer.buff,size,stage.offset);
+        stagingRing->release(stage,future);
+        return future;
+    }
+
+    //copy on the transfer queue, then hand the buffer over to the graphics family
+    CommandPool transferPool = getTransferCommandPool();
+    VkCommandBuffer transferCommands = beginSingleTimeCommands(transferPool.get());
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = stage.offset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(transferCommands, stage.buffer, buffer.buff, 1, &copyRegion);
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = queueFamilies.value().transferFamily.value();
+    barrier.dstQueueFamilyIndex = queueFamilies.value().graphicsFamily.value();
+    barrier.buffer = buffer.buff;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    //release
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(transferCommands,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr,
+        1, &barrier,
+        0, nullptr);
+
+    //acquire
+    VkCommandBuffer acquireCommands = beginSingleTimeCommands(commandPool);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = bufferUsageAccessMask(bufferUsage);
+    vkCmdPipelineBarrier(acquireCommands,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr,
+        1, &barrier,
+        0, nullptr);
+
+    future = endOwnershipTransferAsync(transferPool.get(),transferCommands,commandPool,acquireCommands);
+
+    //the transfer pool stays borrowed until its command buffer is done
+    ThreadCommandPool* poolEntry = transferPool.detach();
+    future.then([poolEntry]() { poolEntry->borrowed.store(false,std::memory_order_release); });
+    stagingRing->release(stage,future);
+
+    return future;
+}
+
+staging_ring& instance::getStagingRing() {
+    return *stagingRing;
+}
+
+memory_pools& instance::getMemoryPools()
+{
+    return *memoryPools;
 }
 
 instance::svkbuffer instance::createBufferStaged(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data) {
@@ -827,21 +1213,26 @@ instance::svkbuffer instance::createUniformBuffer(VkDeviceSize size) {
 }
 
 void instance::copyBufferToBuffer(VkCommandPool commandPool,VkBuffer src, VkBuffer dst,VkDeviceSize size) {
+    copyBufferToBufferAsync(commandPool,src,dst,size).wait();
+}
+
+instance::svkfuture instance::copyBufferToBufferAsync(VkCommandPool commandPool,VkBuffer src, VkBuffer dst,VkDeviceSize size,VkDeviceSize srcOffset) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
 
     VkBufferCopy copyRegion; memset(&copyRegion,0,sizeof(copyRegion));
-    copyRegion.srcOffset = 0; 
+    copyRegion.srcOffset = srcOffset; 
     copyRegion.dstOffset = 0;
     copyRegion.size = size;
     vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
 
-    endSingleTimeCommands(commandPool,commandBuffer);
+    return endSingleTimeCommandsAsync(commandPool,commandBuffer);
 }
 
 instance::svkimage instance::createImage(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo) {
     instance::svkimage image{};
     vmaCreateImage(allocator,&imageInfo,&allocInfo,&image.image,&image.alloc,&image.allocInfo);
     image.mipLevels = imageInfo.mipLevels;
+    image.format = imageInfo.format;
 
     return std::move(image);
 }
@@ -860,6 +1251,13 @@ instance::svkimage instance::createComputeImage(VkImageType imageType, VkExtent3
     imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+    uint32_t families[] = { getGraphicsFamily(), getComputeFamily() };
+    if (dedicatedComputeQueue) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = 2;
+        imageInfo.pQueueFamilyIndices = families;
+    }
+
     VmaAllocationCreateInfo allocInfo{};
     allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
     allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
@@ -868,9 +1266,19 @@ instance::svkimage instance::createComputeImage(VkImageType imageType, VkExtent3
 }
 
 void instance::transitionImageLayout(instance::svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, VkCommandPool commandPool)
+{
+    transitionImageLayoutAsync(image,format,oldLayout,newLayout,commandPool).wait();
+}
+
+instance::svkfuture instance::transitionImageLayoutAsync(instance::svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, VkCommandPool commandPool)
 {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+    recordTransitionImageLayout(commandBuffer,image,format,oldLayout,newLayout);
+    return endSingleTimeCommandsAsync(commandPool,commandBuffer);
+}
 
+void instance::recordTransitionImageLayout(VkCommandBuffer commandBuffer, instance::svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -928,9 +1336,6 @@ void instance::transitionImageLayout(instance::svkimage& image, VkFormat format,
         0, nullptr,
         1, &barrier
     );
-
-
-    endSingleTimeCommands(commandPool,commandBuffer);
 }
 
 void instance::transitionImageLayout(svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
@@ -939,10 +1344,18 @@ void instance::transitionImageLayout(svkimage& image, VkFormat format, VkImageLa
 }
 
 void instance::copyBufferToImage(instance::svkbuffer& buffer,instance::svkimage& image, VkExtent3D extent, VkCommandPool commandPool) {
+    copyBufferToImageAsync(buffer,image,extent,commandPool).wait();
+}
+
+instance::svkfuture instance::copyBufferToImageAsync(instance::svkbuffer& buffer,instance::svkimage& image, VkExtent3D extent, VkCommandPool commandPool) {
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+    recordCopyBufferToImage(commandBuffer,buffer.buff,0,image,extent);
+    return endSingleTimeCommandsAsync(commandPool,commandBuffer);
+}
 
+void instance::recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, instance::svkimage& image, VkExtent3D extent) {
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
 
@@ -956,14 +1369,12 @@ void instance::copyBufferToImage(instance::svkbuffer& buffer,instance::svkimage&
 
     vkCmdCopyBufferToImage(
         commandBuffer,
-        buffer.buff,
+        buffer,
         image.image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
         &region
     );
-
-    endSingleTimeCommands(commandPool,commandBuffer);
 }
 
 void instance::copyBufferToImage(instance::svkbuffer& buffer,instance::svkimage& image, VkExtent3D extent) {
@@ -1001,26 +1412,96 @@ void instance::copyImageToImage(instance::svkimage &src, instance::svkimage &dst
 
 instance::svkimage instance::createImageStaged(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, VkCommandPool commandPool, const void *data)
 {
-    instance::svkbuffer stageBuffer = createStagingBuffer(imageInfo.extent.width * imageInfo.extent.height * imageInfo.extent.depth * 4);
+    instance::svkimage image{};
+    createImageStagedAsync(imageInfo,allocInfo,commandPool,data,image).wait();
+    return image;
+}
+
+instance::svkfuture instance::createImageStagedAsync(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, VkCommandPool commandPool, const void *data, instance::svkimage& image)
+{
+    staging_ring::allocation stage = stagingRing->upload(data,imageInfo.extent.width * imageInfo.extent.height * imageInfo.extent.depth * 4);
 
-    memcpy(stageBuffer.allocInfo.pMappedData,data,imageInfo.extent.width * imageInfo.extent.height * imageInfo.extent.depth * 4);
+    image = createImage(imageInfo,allocInfo);
+    const VkOffset3D texSize = {static_cast<int32_t>(imageInfo.extent.width),static_cast<int32_t>(imageInfo.extent.height),static_cast<int32_t>(imageInfo.extent.depth)};
 
-    instance::svkimage image = createImage(imageInfo,allocInfo);
+    svkfuture future;
+    if (dedicatedTransferQueue) {
+        //copy on the transfer queue, mips are blitted on graphics after the acquire
+        const VkImageLayout finalLayout = imageInfo.mipLevels > 1 ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    transitionImageLayout(image,VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,commandPool);
-    copyBufferToImage(stageBuffer,image,imageInfo.extent,commandPool);
-    destroyBuffer(stageBuffer);
-    if (imageInfo.mipLevels > 1)
-        generateMipmaps(image, VK_FORMAT_R8G8B8A8_SRGB, {static_cast<int32_t>(imageInfo.extent.width),static_cast<int32_t>(imageInfo.extent.height),static_cast<int32_t>(imageInfo.extent.depth)}, commandPool);
-    else
-        transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,commandPool);
-    // transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,commandPool);
+        CommandPool transferPool = getTransferCommandPool();
+        VkCommandBuffer transferCommands = beginSingleTimeCommands(transferPool.get());
+        recordTransitionImageLayout(transferCommands,image,VK_FORMAT_R8G8B8A8_SRGB,VK_IMAGE_LAYOUT_UNDEFINED,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        recordCopyBufferToImage(transferCommands,stage.buffer,stage.offset,image,imageInfo.extent);
 
-    return image;
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = finalLayout;
+        barrier.srcQueueFamilyIndex = queueFamilies.value().transferFamily.value();
+        barrier.dstQueueFamilyIndex = queueFamilies.value().graphicsFamily.value();
+        barrier.image = image.image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = image.mipLevels;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        //release
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(transferCommands,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        //acquire
+        VkCommandBuffer acquireCommands = beginSingleTimeCommands(commandPool);
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = imageInfo.mipLevels > 1 ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(acquireCommands,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, imageInfo.mipLevels > 1 ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            1, &barrier);
+
+        if (imageInfo.mipLevels > 1)
+            recordGenerateMipmaps(acquireCommands, image, VK_FORMAT_R8G8B8A8_SRGB, texSize);
+
+        future = endOwnershipTransferAsync(transferPool.get(),transferCommands,commandPool,acquireCommands);
+
+        ThreadCommandPool* poolEntry = transferPool.detach();
+        future.then([poolEntry]() { poolEntry->borrowed.store(false,std::memory_order_release); });
+    } else {
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+        recordTransitionImageLayout(commandBuffer,image,VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        recordCopyBufferToImage(commandBuffer,stage.buffer,stage.offset,image,imageInfo.extent);
+        if (imageInfo.mipLevels > 1)
+            recordGenerateMipmaps(commandBuffer, image, VK_FORMAT_R8G8B8A8_SRGB, texSize);
+        else
+            recordTransitionImageLayout(commandBuffer,image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        future = endSingleTimeCommandsAsync(commandPool,commandBuffer);
+    }
+
+    stagingRing->release(stage,future);
+
+    return future;
 }
 
 instance::svkimage instance::create2DImageFromFile(const char* file,uint32_t mipLevels,VkCommandPool commandPool)
 {
+    //block compressed through the cache, encoded once on the first run
+    //otherwise the loader builds the mips on the cpu instead of blitting them
+    //the loader records into commandPool and decodes on this thread too, so it is safe on threadpool workers
+    if (textureCache != nullptr || mipLevels > 1) {
+        texture_loader loader(*this, stagingRingSize / 2, commandPool);
+        loader.add(file, mipLevels);
+        instance::svkimage image = loader.load()[0];
+        loader.wait();
+        return image;
+    }
+
     int texWidth, texHeight, texChannels;
     stbi_uc* pixels = stbi_load(file, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
     VkDeviceSize imageSize = texWidth * texHeight * 4;
@@ -1047,6 +1528,7 @@ instance::svkimage instance::create2DImageFromFile(const char* file,uint32_t mip
     VmaAllocationCreateInfo allocInfo{};
     allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
     allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    memoryPools->selectPool(memory_pools::category::texture,imageInfo,allocInfo);
 
     instance::svkimage image = createImageStaged(imageInfo,allocInfo,commandPool,pixels);
 
@@ -1060,6 +1542,24 @@ instance::svkimage instance::create2DImageFromFile(const char* file, uint32_t mi
     return create2DImageFromFile(file, mipLevels, commandPool.get());
 }
 
+bool instance::enableTextureCache(const std::string& directory, VkFormat format)
+{
+    const bcn_encoder::format encoding = bcn_encoder::fromVkFormat(format);
+    if (!textureCompressionBC ||
+        !supportsFormat(bcn_encoder::toVkFormat(encoding, true), VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) ||
+        !supportsFormat(bcn_encoder::toVkFormat(encoding, false), VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        textureCache.reset();
+        return false;
+    }
+    textureCache = std::make_unique<texture_cache>(directory, format);
+    return true;
+}
+
+texture_cache* instance::getTextureCache()
+{
+    return textureCache.get();
+}
+
 void instance::createImageView(svkimage& image, VkFormat format, VkImageViewType viewType, VkImageAspectFlags aspectFlags)
 {
     VkImageViewCreateInfo viewInfo{};
@@ -1140,6 +1640,17 @@ void instance::createSampler(svkimage& image,VkFilter mFilter, VkSamplerAddressM
 }
 
 void instance::generateMipmaps(svkimage& image, VkFormat imageFormat, VkOffset3D texSize, VkCommandPool commandPool) {
+    generateMipmapsAsync(image,imageFormat,texSize,commandPool).wait();
+}
+
+instance::svkfuture instance::generateMipmapsAsync(svkimage& image, VkFormat imageFormat, VkOffset3D texSize, VkCommandPool commandPool) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
+    recordGenerateMipmaps(commandBuffer,image,imageFormat,texSize);
+    return endSingleTimeCommandsAsync(commandPool,commandBuffer);
+}
+
+//expects every level in TRANSFER_DST_OPTIMAL, leaves every level in SHADER_READ_ONLY_OPTIMAL
+void instance::recordGenerateMipmaps(VkCommandBuffer commandBuffer, svkimage& image, VkFormat imageFormat, VkOffset3D texSize) {
     // Check if image format supports linear blitting
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(physicalDevice, imageFormat, &formatProperties);
@@ -1148,8 +1659,6 @@ void instance::generateMipmaps(svkimage& image, VkFormat imageFormat, VkOffset3D
         throw std::runtime_error("texture image format does not support linear blitting!");
     }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool);
-
     VkImageMemoryBarrier barrier{};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.image = image.image;
@@ -1224,20 +1733,41 @@ void instance::generateMipmaps(svkimage& image, VkFormat imageFormat, VkOffset3D
         0, NULL,
         0, NULL,
         1, &barrier);
-
-    endSingleTimeCommands(commandPool,commandBuffer);
 }
 
 VkCommandBuffer instance::beginSingleTimeCommands(VkCommandPool commandPool)
 {
-    VkCommandBufferAllocateInfo allocInfo; memset(&allocInfo,0,sizeof(allocInfo));
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+    //thread affine pools keep a free list, vkBeginCommandBuffer resets a recycled buffer implicitly
+    ThreadCommandPool* entry = findThreadCommandPool(commandPool);
+    if (entry != nullptr) {
+        if (entry->available.empty())
+            recycleRetiredCommandBuffers(*entry);
+        if (entry->available.empty()) {
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandPool = commandPool;
+            allocInfo.commandBufferCount = commandBufferBatch;
+
+            entry->available.resize(commandBufferBatch);
+            if (vkAllocateCommandBuffers(device, &allocInfo, entry->available.data()) != VK_SUCCESS) {
+                entry->available.clear();
+                throw std::runtime_error("failed to allocate command buffers!");
+            }
+        }
+        commandBuffer = entry->available.back();
+        entry->available.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocInfo; memset(&allocInfo,0,sizeof(allocInfo));
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = commandPool;
+        allocInfo.commandBufferCount = 1;
 
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+        vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+    }
 
     VkCommandBufferBeginInfo beginInfo; memset(&beginInfo,0,sizeof(beginInfo));
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -1249,21 +1779,255 @@ VkCommandBuffer instance::beginSingleTimeCommands(VkCommandPool commandPool)
 }
 
 void instance::endSingleTimeCommands(VkCommandPool commandPool,VkCommandBuffer commandBuffer) {
+    //waits on its own fence instead of idling the queue
+    endSingleTimeCommandsAsync(commandPool,commandBuffer).wait();
+}
+
+instance::svkfuture instance::endSingleTimeCommandsAsync(VkCommandPool commandPool,VkCommandBuffer commandBuffer) {
     vkEndCommandBuffer(commandBuffer);
 
+    svkfuture future;
+    future.s = std::make_shared<svkfuture::state>();
+    future.s->inst = this;
+    future.s->fence = acquireFence();
+    future.s->commandBuffers.push_back({commandPool,commandBuffer,findThreadCommandPool(commandPool)});
+
     VkSubmitInfo submitInfo; memset(&submitInfo,0,sizeof(submitInfo));
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    if (graphicsQueue.submit(1,&submitInfo,VK_NULL_HANDLE) != VK_SUCCESS) {
+    if (graphicsQueue.submit(1,&submitInfo,future.s->fence) != VK_SUCCESS) {
         throw std::runtime_error("Failed to submit queue (endSingleTimeCommands)");
     }
-    graphicsQueue.waitIdle();
+    trackFuture(future);
+
+    return future;
+}
+
+void instance::endOwnershipTransfer(VkCommandPool transferPool,VkCommandBuffer transferCommands,VkCommandPool graphicsPool,VkCommandBuffer acquireCommands) {
+    endOwnershipTransferAsync(transferPool,transferCommands,graphicsPool,acquireCommands).wait();
+}
+
+instance::svkfuture instance::endOwnershipTransferAsync(VkCommandPool transferPool,VkCommandBuffer transferCommands,VkCommandPool graphicsPool,VkCommandBuffer acquireCommands) {
+    vkEndCommandBuffer(transferCommands);
+    vkEndCommandBuffer(acquireCommands);
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkSemaphore released;
+    if (vkCreateSemaphore(device,&semaphoreInfo,nullptr,&released) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create ownership transfer sync objects");
+    }
+
+    svkfuture future;
+    future.s = std::make_shared<svkfuture::state>();
+    future.s->inst = this;
+    future.s->fence = acquireFence();
+    future.s->commandBuffers.push_back({transferPool,transferCommands,findThreadCommandPool(transferPool)});
+    future.s->commandBuffers.push_back({graphicsPool,acquireCommands,findThreadCommandPool(graphicsPool)});
+
+    VkSubmitInfo releaseInfo{};
+    releaseInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    releaseInfo.commandBufferCount = 1;
+    releaseInfo.pCommandBuffers = &transferCommands;
+    releaseInfo.signalSemaphoreCount = 1;
+    releaseInfo.pSignalSemaphores = &released;
+
+    if (transferQueue.submit(releaseInfo,VK_NULL_HANDLE) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit queue (endOwnershipTransfer)");
+    }
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo{};
+    acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &released;
+    acquireInfo.pWaitDstStageMask = &waitStage;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &acquireCommands;
+
+    //the acquire waits on the release so the fence covers both submissions
+    if (graphicsQueue.submit(acquireInfo,future.s->fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit queue (endOwnershipTransfer)");
+    }
+
+    trackFuture(future);
+
+    VkDevice device = this->device;
+    future.then([device,released]() { vkDestroySemaphore(device,released,nullptr); });
+
+    return future;
+}
+
+instance::svkfuture instance::fenceGraphicsQueue() {
+    svkfuture future;
+    future.s = std::make_shared<svkfuture::state>();
+    future.s->inst = this;
+    future.s->fence = acquireFence();
+
+    //a fence signal covers every earlier submission on the queue
+    if (graphicsQueue.submit(0,nullptr,future.s->fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit queue (fenceGraphicsQueue)");
+    }
+    trackFuture(future);
+
+    return future;
+}
+
+//fence pool
+
+VkFence instance::acquireFence() {
+    {
+        std::lock_guard<std::mutex> lock(fenceMutex);
+        if (!freeFences.empty()) {
+            VkFence fence = freeFences.back();
+            freeFences.pop_back();
+            return fence;
+        }
+    }
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device,&fenceInfo,nullptr,&fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create fence!");
+    }
+    return fence;
+}
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+void instance::releaseFence(VkFence fence) {
+    vkResetFences(device,1,&fence);
+    std::lock_guard<std::mutex> lock(fenceMutex);
+    freeFences.push_back(fence);
 }
 
+void instance::destroyFences() {
+    std::lock_guard<std::mutex> lock(fenceMutex);
+    for (VkFence fence : freeFences) {
+        vkDestroyFence(device,fence,nullptr);
+    }
+    freeFences.clear();
+}
+
+void instance::trackFuture(const svkfuture& future) {
+    //a submit is a good time to retire what finished since the last one
+    collectFutures();
+    future.s->submitter = std::this_thread::get_id();
+    for (svkfuture::state::submitted& submitted : future.s->commandBuffers) {
+        if (submitted.owner != nullptr)
+            submitted.owner->inFlight.fetch_add(1,std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lock(pendingFuturesMutex);
+    pendingFutures.push_back(future.s);
+}
+
+void instance::collectFutures() {
+    std::vector<std::shared_ptr<svkfuture::state>> pending;
+    {
+        std::lock_guard<std::mutex> lock(pendingFuturesMutex);
+        pending.swap(pendingFutures);
+    }
+    //no lock held, callbacks may submit and track new futures
+    const std::thread::id self = std::this_thread::get_id();
+    std::erase_if(pending, [self](const std::shared_ptr<svkfuture::state>& state) {
+        if (state->submitter != self)
+            return false;
+        svkfuture future;
+        future.s = state;
+        return future.ready();
+    });
+    std::lock_guard<std::mutex> lock(pendingFuturesMutex);
+    pendingFutures.insert(pendingFutures.end(), pending.begin(), pending.end());
+}
+
+void instance::drainFutures() {
+    //callbacks may submit more work, so repeat until nothing is left
+    for (;;) {
+        std::vector<std::shared_ptr<svkfuture::state>> pending;
+        {
+            std::lock_guard<std::mutex> lock(pendingFuturesMutex);
+            pending.swap(pendingFutures);
+        }
+        if (pending.empty())
+            return;
+        for (const std::shared_ptr<svkfuture::state>& state : pending) {
+            svkfuture future;
+            future.s = state;
+            future.wait();
+        }
+    }
+}
+
+//fence pool end
+
+//SVKFUTURE
+
+void instance::svkfuture::complete() {
+    instance& inst = *s->inst;
+    for (state::submitted& submitted : s->commandBuffers) {
+        if (submitted.owner != nullptr) {
+            //the owning thread may be recording into the pool right now
+            std::lock_guard<std::mutex> lock(submitted.owner->retiredMutex);
+            submitted.owner->retired.push_back(submitted.commandBuffer);
+            submitted.owner->inFlight.fetch_sub(1,std::memory_order_release);
+        } else {
+            vkFreeCommandBuffers(inst.device, submitted.pool, 1, &submitted.commandBuffer);
+        }
+    }
+    s->commandBuffers.clear();
+    inst.releaseFence(s->fence);
+    s->fence = VK_NULL_HANDLE;
+    s->completed = true;
+
+    for (std::function<void()>& func : s->onComplete) {
+        func();
+    }
+    s->onComplete.clear();
+}
+
+bool instance::svkfuture::ready() {
+    if (!s)
+        return true;
+    //someone else is completing or waiting on it
+    std::unique_lock<std::recursive_mutex> lock(s->mutex, std::try_to_lock);
+    if (!lock.owns_lock())
+        return false;
+    if (s->completed)
+        return true;
+    if (vkGetFenceStatus(s->inst->device, s->fence) != VK_SUCCESS)
+        return false;
+    complete();
+    return true;
+}
+
+void instance::svkfuture::wait() {
+    if (!s)
+        return;
+    std::lock_guard<std::recursive_mutex> lock(s->mutex);
+    if (s->completed)
+        return;
+    vkWaitForFences(s->inst->device, 1, &s->fence, VK_TRUE, UINT64_MAX);
+    complete();
+}
+
+void instance::svkfuture::then(std::function<void()> func) {
+    if (!s) {
+        func();
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(s->mutex);
+    if (s->completed) {
+        func();
+        return;
+    }
+    s->onComplete.push_back(std::move(func));
+}
+
+//SVKFUTURE END
+
 void instance::destroyBuffer(instance::svkbuffer& buffer) {
     vmaDestroyBuffer(allocator,buffer.buff,buffer.alloc);
 }
@@ -1288,6 +2052,11 @@ void instance::destroySampler(VkSampler sampler)
     vkDestroySampler(device, sampler, NULL);
 }
 
+deletion_queue& instance::getDeletionQueue()
+{
+    return *deletionQueue;
+}
+
 // Vulkan Memory Allocator end
 
 descriptor::allocator_pool instance::getDescriptorPool()
@@ -1367,6 +2136,166 @@ graphics::IndexBufferInfo instance::svkbuffer::getIndexBufferInfo(VkIndexType in
 //     inst->destroyBuffer(*this);
 // }
 
+//HANDLES
+
+instance::bufferHandle instance::createBufferHandle(VkBufferCreateInfo bufferCreateInfo, VmaAllocationCreateInfo allocCreateInfo)
+{
+    svkbuffer buffer = createBuffer(bufferCreateInfo, allocCreateInfo, bufferCreateInfo.size);
+    if (buffer.buff == VK_NULL_HANDLE) {
+        throw std::runtime_error("failed to create buffer!");
+    }
+    return adoptBuffer(buffer);
+}
+
+instance::bufferHandle instance::adoptBuffer(const svkbuffer& buffer)
+{
+    bufferHandle h{bufferSlots.allocate()};
+    hotBuffers.reserve(h.index());
+    coldBuffers.reserve(h.index());
+    hotBuffers[h.index()] = {buffer.buff, buffer.size, buffer.allocInfo.pMappedData};
+    coldBuffers[h.index()] = buffer.alloc;
+    return h;
+}
+
+instance::hotBuffer instance::getBuffer(bufferHandle buffer) const
+{
+    hotBuffer hot;
+    if (!bufferSlots.read(buffer.value, [&]() { hot = hotBuffers[buffer.index()]; })) {
+        throw std::runtime_error("stale buffer handle!");
+    }
+    return hot;
+}
+
+VmaAllocation instance::getAllocation(bufferHandle buffer) const
+{
+    VmaAllocation alloc;
+    if (!bufferSlots.read(buffer.value, [&]() { alloc = coldBuffers[buffer.index()]; })) {
+        throw std::runtime_error("stale buffer handle!");
+    }
+    return alloc;
+}
+
+instance::svkbuffer instance::getSvkBuffer(bufferHandle buffer) const
+{
+    svkbuffer result{};
+    if (!bufferSlots.read(buffer.value, [&]() {
+        const hotBuffer& hot = hotBuffers[buffer.index()];
+        result.buff = hot.buffer;
+        result.size = hot.size;
+        result.alloc = coldBuffers[buffer.index()];
+    })) {
+        throw std::runtime_error("stale buffer handle!");
+    }
+    vmaGetAllocationInfo(allocator, result.alloc, &result.allocInfo);
+    return result;
+}
+
+void instance::destroyBuffer(bufferHandle buffer)
+{
+    //released first so other threads see the handle as stale before the buffer goes away
+    const svkbuffer destroyed = getSvkBuffer(buffer);
+    bufferSlots.release(buffer.value);
+    vmaDestroyBuffer(allocator, destroyed.buff, destroyed.alloc);
+}
+
+instance::imageHandle instance::createImageHandle(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo)
+{
+    svkimage image = createImage(imageInfo, allocInfo);
+    if (image.image == VK_NULL_HANDLE) {
+        throw std::runtime_error("failed to create image!");
+    }
+    return adoptImage(image);
+}
+
+instance::imageHandle instance::adoptImage(const svkimage& image)
+{
+    imageHandle h{imageSlots.allocate()};
+    hotImages.reserve(h.index());
+    coldImages.reserve(h.index());
+    hotImages[h.index()] = {image.image, image.view.value_or(VK_NULL_HANDLE), image.sampler.value_or(VK_NULL_HANDLE)};
+    coldImages[h.index()] = {image.alloc, image.mipLevels, image.format};
+    return h;
+}
+
+instance::hotImage instance::getImage(imageHandle image) const
+{
+    hotImage hot;
+    if (!imageSlots.read(image.value, [&]() { hot = hotImages[image.index()]; })) {
+        throw std::runtime_error("stale image handle!");
+    }
+    return hot;
+}
+
+VmaAllocation instance::getAllocation(imageHandle image) const
+{
+    VmaAllocation alloc;
+    if (!imageSlots.read(image.value, [&]() { alloc = coldImages[image.index()].alloc; })) {
+        throw std::runtime_error("stale image handle!");
+    }
+    return alloc;
+}
+
+uint32_t instance::getMipLevels(imageHandle image) const
+{
+    uint32_t mipLevels;
+    if (!imageSlots.read(image.value, [&]() { mipLevels = coldImages[image.index()].mipLevels; })) {
+        throw std::runtime_error("stale image handle!");
+    }
+    return mipLevels;
+}
+
+instance::svkimage instance::getSvkImage(imageHandle image) const
+{
+    hotImage hot;
+    coldImage cold;
+    if (!imageSlots.read(image.value, [&]() {
+        hot = hotImages[image.index()];
+        cold = coldImages[image.index()];
+    })) {
+        throw std::runtime_error("stale image handle!");
+    }
+    svkimage result{};
+    result.image = hot.image;
+    if (hot.view != VK_NULL_HANDLE)
+        result.view = hot.view;
+    if (hot.sampler != VK_NULL_HANDLE)
+        result.sampler = hot.sampler;
+    result.alloc = cold.alloc;
+    result.mipLevels = cold.mipLevels;
+    result.format = cold.format;
+    vmaGetAllocationInfo(allocator, result.alloc, &result.allocInfo);
+    return result;
+}
+
+VkDescriptorImageInfo instance::getImageInfo(imageHandle image) const
+{
+    const hotImage hot = getImage(image);
+    VkDescriptorImageInfo imageInfo;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = hot.view;
+    imageInfo.sampler = hot.sampler;
+    return imageInfo;
+}
+
+void instance::destroyImage(imageHandle image)
+{
+    svkimage destroyed = getSvkImage(image);
+    imageSlots.release(image.value);
+    destroyImage(destroyed);
+}
+
+void instance::destroyHandles()
+{
+    for (uint32_t value : bufferSlots.live()) {
+        destroyBuffer(bufferHandle{value});
+    }
+    for (uint32_t value : imageSlots.live()) {
+        destroyImage(imageHandle{value});
+    }
+}
+
+//HANDLES END
+
 VkDescriptorImageInfo instance::svkimage::getImageInfo()
 {
     VkDescriptorImageInfo imageInfo;
@@ -1380,8 +2309,8 @@ VkDescriptorImageInfo instance::svkimage::getImageInfo()
 
 
 //CommandPool class
-instance::CommandPool::CommandPool(instance &inst, const VkCommandPool commandPool, const int id)
-    : inst(inst), id(id), pool(commandPool)
+instance::CommandPool::CommandPool(instance &inst, ThreadCommandPool* entry)
+    : inst(inst), entry(entry), pool(entry->pool)
 {}
 
 instance::CommandPool::~CommandPool()
@@ -1394,17 +2323,25 @@ VkCommandPool instance::CommandPool::get()
     return pool;
 }
 
+instance::ThreadCommandPool* instance::CommandPool::detach()
+{
+    ThreadCommandPool* entry = this->entry;
+    this->entry = nullptr;
+    this->pool = VK_NULL_HANDLE;
+    return entry;
+}
+
 void instance::CommandPool::returnPool()
 {
-    if (this->pool == VK_NULL_HANDLE) 
+    if (this->entry == nullptr) 
         return;
+    //only the owning thread submits from the pool, so nothing can start using it between the check and the reset
+    //while futures are pending the pool is left alone, a later return resets it
+    if (this->entry->inFlight.load(std::memory_order_acquire) == 0)
+        vkResetCommandPool(inst.device,this->pool,0);
     this->pool = VK_NULL_HANDLE;
-    static threadpool* pool = threadpool::get_instance();
-    instance& inst = this->inst;
-    int id = this->id;
-    pool->add_task([&inst,id](){
-        inst.returnCommandPool(id);
-    });
+    this->entry->borrowed.store(false,std::memory_order_release);
+    this->entry = nullptr;
 }
 //CommandPool class end
 
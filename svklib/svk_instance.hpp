@@ -4,6 +4,7 @@
 #include "svk_forward_declarations.hpp"
 
 #include "svk_descriptor.hpp"
+#include "svk_handles.hpp"
 
 namespace svklib {
 
@@ -11,11 +12,19 @@ class instance {
     friend class swapchain;
     friend class graphics::pipeline;
     friend class renderer;
+    friend class staging_ring;
+    friend class upload_batch;
+    friend class memory_pools;
 public:
     instance(window& win,uint32_t apiVersion);
     instance(window& win,uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures);
     instance(window& win,uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures,std::vector<const char*> extensions);
 
+    //headless, no window/surface/swapchain extension (offscreen rendering and compute only)
+    instance(uint32_t apiVersion);
+    instance(uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures);
+    instance(uint32_t apiVersion,VkPhysicalDeviceFeatures enabledFeatures,std::vector<const char*> extensions);
+
     instance(const instance&) = delete;
     instance& operator=(const instance&) = delete;
 
@@ -23,12 +32,13 @@ public:
     ~instance();
 
     inline void waitForDeviceIdle() { vkDeviceWaitIdle(device); }
+    inline bool isHeadless() const { return win == nullptr; }
     
     const uint32_t apiVersion;
 
 private:
     //references
-    window& win;
+    window* win; //nullptr when headless
     //references end
 #ifdef _DEBUG
     static constexpr bool enableValidationLayers = true;
@@ -39,9 +49,11 @@ private:
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        std::optional<uint32_t> transferFamily; //transfer-only family if there is one, otherwise graphicsFamily
+        std::optional<uint32_t> computeFamily; //compute family without graphics if there is one, otherwise graphicsFamily
 
-        bool isComplete() {
-            return graphicsFamily.has_value() && presentFamily.has_value();
+        bool isComplete(bool headless) {
+            return graphicsFamily.has_value() && (headless || presentFamily.has_value());
         }
     };
 
@@ -101,6 +113,7 @@ private:
 
 public:
     inline VkSampleCountFlagBits getMaxMsaa() {return maxMsaa;}
+    VkPhysicalDeviceProperties getPhysicalDeviceProperties();
     //VKDEVICE
     VkDevice device;
 
@@ -124,11 +137,69 @@ public:
     svkqueue graphicsQueue;
     svkqueue presentQueue;
 
+    inline bool hasDedicatedTransferQueue() { return dedicatedTransferQueue; }
+    //transfer-only queue when the device has one, otherwise the graphics queue
+    svkqueue& getUploadQueue();
+
+    inline bool hasDedicatedComputeQueue() { return dedicatedComputeQueue; }
+    //async compute queue when the device has one, otherwise the graphics queue
+    svkqueue& getComputeQueue();
+    uint32_t getGraphicsFamily();
+    uint32_t getComputeFamily();
+    uint32_t getTransferFamily();
+
+    //requires Vulkan 1.2, enabled automatically when the device supports it
+    inline bool hasTimelineSemaphores() { return timelineSemaphores; }
+    //VK_EXT_memory_budget, enabled automatically on Vulkan 1.1+ when the device supports it
+    inline bool hasMemoryBudget() { return memoryBudget; }
+    //textureCompressionBC, enabled automatically when the device supports it
+    inline bool hasTextureCompressionBC() { return textureCompressionBC; }
+    //optimal tiling features of format include features
+    bool supportsFormat(VkFormat format, VkFormatFeatureFlags features);
+
+    enum class QueueType { graphics = 0, transfer = 1, compute = 2 };
+    static constexpr uint32_t maxFrameSlots = 8;
+
 private:
+    svkqueue transferQueue;
+    bool dedicatedTransferQueue = false;
+    svkqueue computeQueue;
+    bool dedicatedComputeQueue = false;
+    bool timelineSemaphores = false;
+    bool memoryBudget = false;
+    bool textureCompressionBC = false;
+
+    //command pool owned by one thread, only that thread borrows it so acquiring needs no lock
+    struct ThreadCommandPool {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::atomic_bool borrowed{false}; //returned from any thread
+        //command buffers of completed futures, recycled by the owning thread
+        std::mutex retiredMutex;
+        std::vector<VkCommandBuffer> retired;
+        //command buffers of unfinished futures, the pool is only reset once this drops to zero
+        std::atomic<uint32_t> inFlight{0};
+        //pre-allocated primary command buffers ready for beginSingleTimeCommands, owning thread only
+        std::vector<VkCommandBuffer> available;
+    };
+    static constexpr uint32_t commandBufferBatch = 4; //allocated at once when a pool runs dry
+
+    //transient pool of one thread for one frame slot, its command buffers are reused after each reset
+    struct FrameCommandPool {
+        std::atomic<VkCommandPool> pool{VK_NULL_HANDLE};
+        std::array<std::vector<VkCommandBuffer>,2> commandBuffers; //indexed by VkCommandBufferLevel, owning thread only
+        std::array<std::atomic<uint32_t>,2> used{}; //handed out since the last reset
+    };
+
+    //every command pool of one thread, registered once per thread per instance
+    struct ThreadCommandPools {
+        std::array<std::deque<ThreadCommandPool>,3> pools; //indexed by QueueType, only the owning thread appends
+        std::array<std::array<FrameCommandPool,3>,maxFrameSlots> framePools; //per frame slot and QueueType
+    };
+
     class CommandPool {
     private:
         friend class instance;
-        CommandPool(instance& inst, const VkCommandPool commandPool, const int id);
+        CommandPool(instance& inst, ThreadCommandPool* entry);
     public:
         ~CommandPool();
         CommandPool(const CommandPool&) = delete;
@@ -136,28 +207,76 @@ private:
         VkCommandPool get();
         void returnPool();
     private:
+        //hands the borrowed pool to someone else (a svkfuture), they return it by clearing borrowed
+        ThreadCommandPool* detach();
         instance& inst;
+        ThreadCommandPool* entry;
         VkCommandPool pool;
-        const int id;
     };
     
-    std::vector<VkCommandPool> commandPools;
-    std::vector<bool> commandPoolBorrowed;
+    const uint64_t instanceId; //key of the thread local pool cache
+    std::vector<std::unique_ptr<ThreadCommandPools>> threadCommandPools; //registry, only locked when a thread first shows up
     std::mutex commandPoolMutex;
 
-    void createCommandPools(int count);
+    ThreadCommandPools& getThreadCommandPools();
+    ThreadCommandPool* findThreadCommandPool(VkCommandPool commandPool);
+    void recycleRetiredCommandBuffers(ThreadCommandPool& entry);
     void destroyCommandPools();
-    CommandPool borrowCommandPool();
-    void returnCommandPool(int id);
+    CommandPool borrowCommandPool(QueueType type);
+    uint32_t getQueueFamily(QueueType type);
 
 public:
     // If a commandpool is used to make command buffers that are reused,
     // this command pool should not be returned until the command buffers are no longer in use
     CommandPool getCommandPool();
+    // Command pool for the upload queue family
+    CommandPool getTransferCommandPool();
+    // Command pool for the compute queue family
+    CommandPool getComputeCommandPool();
+
+    // Transient pool of the calling thread for one frame slot, no borrowing or locking.
+    // Only record into it between resetFrameCommandPools(frame) and the submit of that frame
+    VkCommandPool getFrameCommandPool(uint32_t frame, QueueType type = QueueType::graphics);
+    // Command buffer from the calling thread's frame pool, valid until the next reset of that frame slot
+    VkCommandBuffer getFrameCommandBuffer(uint32_t frame, VkCommandBufferLevel level, QueueType type = QueueType::graphics);
+    // Resets the pools of every thread for a frame slot, call once the frame's fence has signaled
+    void resetFrameCommandPools(uint32_t frame);
+
+    //completion handle of a fenced submission, copies share the same state
+    //command buffers of thread affine pools are recycled by their owning thread, others are freed
+    //by whichever thread first observes completion, so such a pool must outlive the future
+    //the instance keeps the state of every submission until it completes, so dropping all copies is fine
+    class svkfuture {
+    private:
+        friend class instance;
+        struct state {
+            instance* inst = nullptr;
+            VkFence fence = VK_NULL_HANDLE;
+            struct submitted {
+                VkCommandPool pool;
+                VkCommandBuffer commandBuffer;
+                ThreadCommandPool* owner; //nullptr if the pool is not thread affine
+            };
+            std::vector<submitted> commandBuffers;
+            std::vector<std::function<void()>> onComplete;
+            bool completed = false;
+            std::thread::id submitter; //the instance only completes dropped futures on this thread
+            std::recursive_mutex mutex; //callbacks may chain then() on the same future
+        };
+        std::shared_ptr<state> s;
+        void complete(); //expects s->mutex held
+    public:
+        svkfuture() = default; //already completed
+        bool ready(); //non blocking
+        void wait();
+        //runs immediately if already completed, otherwise on the thread that observes completion
+        void then(std::function<void()> func);
+    };
 
 
 private:
     VkCommandPool createCommandPool();
+    VkCommandPool createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
     void destroyCommandPool(VkCommandPool commandPool);
 
     std::unique_ptr<VkPhysicalDeviceFeatures> requestedFeatures;
@@ -194,8 +313,30 @@ public:
     //Transfer bit already selected
     svkbuffer createBufferStaged(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data);
     svkbuffer createUniformBuffer(VkDeviceSize size);
+    //device local, host visible and mapped when the device has such memory (ReBAR/UMA), transfer dst otherwise
+    svkbuffer createDeviceBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize size);
+    bool isHostVisible(svkbuffer& buffer);
+    //memcpy straight into buffer, returns false without writing when it is not host visible and has to be staged
+    //nothing orders the write against the gpu, only use it on ranges no submitted work reads (new allocations)
+    bool writeBufferDirect(svkbuffer& buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
     void copyBufferToBuffer(VkCommandPool commandPool,VkBuffer src, VkBuffer dst,VkDeviceSize size);
 
+    //non blocking variants, the staging buffer is destroyed when the returned future completes
+    svkfuture createBufferStagedAsync(VkBufferUsageFlags bufferUsage, VkDeviceSize size,const void* data,VkCommandPool commandPool,svkbuffer& buffer);
+    svkfuture copyBufferToBufferAsync(VkCommandPool commandPool,VkBuffer src, VkBuffer dst,VkDeviceSize size,VkDeviceSize srcOffset = 0);
+
+    //shared staging memory for all staged uploads
+    static constexpr VkDeviceSize stagingRingSize = 32 * 1024 * 1024;
+    staging_ring& getStagingRing();
+    //budgeted pools per resource category, staging buffers are allocated from them
+    memory_pools& getMemoryPools();
+private:
+    std::unique_ptr<staging_ring> stagingRing;
+    std::unique_ptr<memory_pools> memoryPools;
+    std::unique_ptr<deletion_queue> deletionQueue;
+    std::unique_ptr<texture_cache> textureCache;
+public:
+
     struct svkimage {
         VmaAllocation alloc;
         VmaAllocationInfo allocInfo;
@@ -203,6 +344,7 @@ public:
         std::optional<VkImageView> view;
         std::optional<VkSampler> sampler;
         uint32_t mipLevels;
+        VkFormat format = VK_FORMAT_UNDEFINED; //the format to create views with
         VkDescriptorImageInfo getImageInfo();
     };
 
@@ -218,19 +360,116 @@ public:
     void copyImageToImage(svkimage& src, svkimage& dst, VkExtent3D extent); //UNTESTED
     
     svkimage createImageStaged(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, VkCommandPool commandPool, const void* data);
+    svkfuture createImageStagedAsync(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, VkCommandPool commandPool, const void* data, svkimage& image);
+    //graphics commands are recorded into commandPool, it must be reset only after the call returns
+    //safe to call from threadpool workers, decoding never waits on other workers
     svkimage create2DImageFromFile(const char* file,uint32_t mipLevels,VkCommandPool commandPool);
     svkimage create2DImageFromFile(const char* file,uint32_t mipLevels);
+    //with a cache enabled, create2DImageFromFile and texture_loader::add return block compressed images,
+    //create their views with svkimage::format. returns false and stays disabled when the device cannot sample format
+    bool enableTextureCache(const std::string& directory, VkFormat format = VK_FORMAT_BC7_SRGB_BLOCK);
+    texture_cache* getTextureCache(); //nullptr while disabled
 
     void createImageView(svkimage& image, VkFormat format, VkImageViewType viewType,VkImageAspectFlags aspectFlags);
     void createSampler(svkimage& image, VkFilter mFilter,VkSamplerAddressMode samplerAddressMode);
     void generateMipmaps(svkimage& image, VkFormat imageFormat, VkOffset3D texSize,VkCommandPool commandPool);
 
+    svkfuture transitionImageLayoutAsync(svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,VkCommandPool commandPool);
+    svkfuture copyBufferToImageAsync(svkbuffer& buffer, svkimage& image, VkExtent3D extent,VkCommandPool commandPool);
+    svkfuture generateMipmapsAsync(svkimage& image, VkFormat imageFormat, VkOffset3D texSize,VkCommandPool commandPool);
+
     VkCommandBuffer beginSingleTimeCommands(VkCommandPool commandPool);
     void endSingleTimeCommands(VkCommandPool commandPool,VkCommandBuffer commandBuffer);
+    svkfuture endSingleTimeCommandsAsync(VkCommandPool commandPool,VkCommandBuffer commandBuffer);
+    //submits the release half on the upload queue and the acquire half on the graphics queue
+    void endOwnershipTransfer(VkCommandPool transferPool,VkCommandBuffer transferCommands,VkCommandPool graphicsPool,VkCommandBuffer acquireCommands);
+    svkfuture endOwnershipTransferAsync(VkCommandPool transferPool,VkCommandBuffer transferCommands,VkCommandPool graphicsPool,VkCommandBuffer acquireCommands);
+    //empty submission, completes once everything submitted to the graphics queue before it has
+    svkfuture fenceGraphicsQueue();
     void destroyBuffer(svkbuffer& buffer);
     void destroyImage(svkimage& image);
     void destroyImageView(VkImageView imageView);
     void destroySampler(VkSampler sampler);
+    //destroys resources once the frames or timeline values still using them have completed
+    deletion_queue& getDeletionQueue();
+
+    //32 bit generational handles into pools that grow a page at a time, the fields used while recording
+    //sit together (hotBuffer/hotImage) and vma data is stored apart, stale handles throw on access
+    using bufferHandle = handle<struct bufferTag>;
+    using imageHandle = handle<struct imageTag>;
+
+    struct hotBuffer {
+        VkBuffer buffer;
+        VkDeviceSize size;
+        void* mapped; //nullptr when not host visible
+    };
+    struct hotImage {
+        VkImage image;
+        VkImageView view; //VK_NULL_HANDLE if none
+        VkSampler sampler; //VK_NULL_HANDLE if none
+    };
+
+    bufferHandle createBufferHandle(VkBufferCreateInfo bufferCreateInfo, VmaAllocationCreateInfo allocCreateInfo);
+    //takes ownership, the buffer is destroyed through the handle from now on
+    bufferHandle adoptBuffer(const svkbuffer& buffer);
+    inline bool isValid(bufferHandle buffer) const { return bufferSlots.valid(buffer.value); }
+    //copies, a reference could change under the caller when another thread destroys the handle
+    hotBuffer getBuffer(bufferHandle buffer) const;
+    VmaAllocation getAllocation(bufferHandle buffer) const;
+    //for the functions taking svkbuffer, allocInfo is queried from vma
+    svkbuffer getSvkBuffer(bufferHandle buffer) const;
+    void destroyBuffer(bufferHandle buffer);
+
+    imageHandle createImageHandle(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo);
+    //takes ownership of the image, its view and sampler
+    imageHandle adoptImage(const svkimage& image);
+    inline bool isValid(imageHandle image) const { return imageSlots.valid(image.value); }
+    hotImage getImage(imageHandle image) const;
+    VmaAllocation getAllocation(imageHandle image) const;
+    uint32_t getMipLevels(imageHandle image) const;
+    svkimage getSvkImage(imageHandle image) const;
+    //shader read only layout, the image needs a view and a sampler
+    VkDescriptorImageInfo getImageInfo(imageHandle image) const;
+    void destroyImage(imageHandle image);
+
+private:
+    handle_slots bufferSlots;
+    handle_table<hotBuffer> hotBuffers;
+    handle_table<VmaAllocation> coldBuffers;
+
+    struct coldImage {
+        VmaAllocation alloc;
+        uint32_t mipLevels;
+        VkFormat format;
+    };
+    handle_slots imageSlots;
+    handle_table<hotImage> hotImages;
+    handle_table<coldImage> coldImages;
+
+    void destroyHandles();
+public:
+
+private:
+    //recycled fences for svkfuture
+    std::vector<VkFence> freeFences;
+    std::mutex fenceMutex;
+    VkFence acquireFence();
+    void releaseFence(VkFence fence);
+    void destroyFences();
+
+    //unfinished futures, dropped ones still complete and run their callbacks
+    std::vector<std::shared_ptr<svkfuture::state>> pendingFutures;
+    std::mutex pendingFuturesMutex;
+    void trackFuture(const svkfuture& future); //after its submit succeeded
+    //completes those of the calling thread whose fence signaled, their pools may be recorded into elsewhere
+    void collectFutures();
+    void drainFutures(); //waits for all of them, before anything they free is destroyed
+
+    void recordTransitionImageLayout(VkCommandBuffer commandBuffer, svkimage& image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
+    void recordCopyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, svkimage& image, VkExtent3D extent);
+    void recordGenerateMipmaps(VkCommandBuffer commandBuffer, svkimage& image, VkFormat imageFormat, VkOffset3D texSize);
+    //access a freshly uploaded buffer is made visible to
+    static VkAccessFlags bufferUsageAccessMask(VkBufferUsageFlags usage);
     
     //Vulkan Memory Allocator end
 public:
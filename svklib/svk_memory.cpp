@@ -0,0 +1,388 @@
+#ifndef SVKLIB_MEMORY_CPP
+#define SVKLIB_MEMORY_CPP
+
+#include "svk_memory.hpp"
+
+#include <fstream>
+#include <sstream>
+
+namespace svklib {
+
+static const char* const categoryNames[memory_pools::categoryCount] = {
+    "render targets", "textures", "geometry", "staging"
+};
+
+memory_pools::memory_pools(instance& inst)
+    : inst(inst)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties;
+    vmaGetMemoryProperties(inst.allocator, &memoryProperties);
+    heapsWarned.assign(memoryProperties->memoryHeapCount, false);
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+        heapOfType[i] = memoryProperties->memoryTypes[i].heapIndex;
+    }
+}
+
+memory_pools::~memory_pools()
+{
+    for (pools& p : categories) {
+        for (auto& [memoryTypeIndex, pool] : p.byMemoryType) {
+            vmaDestroyPool(inst.allocator, pool);
+        }
+    }
+}
+
+void memory_pools::setBudget(category c, VkDeviceSize budget, float warnThreshold)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pools& p = categories[static_cast<uint32_t>(c)];
+        p.budget = budget;
+        p.warnThreshold = warnThreshold;
+        p.warned = false;
+    }
+    checkCategory(c);
+}
+
+VkDeviceSize memory_pools::getBudget(category c)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return categories[static_cast<uint32_t>(c)].budget;
+}
+
+VmaPool memory_pools::getPool(category c, uint32_t memoryTypeIndex)
+{
+    pools& p = categories[static_cast<uint32_t>(c)];
+    auto it = p.byMemoryType.find(memoryTypeIndex);
+    if (it != p.byMemoryType.end())
+        return it->second;
+
+    VmaPoolCreateInfo poolInfo{};
+    poolInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VmaPool pool;
+    if (vmaCreatePool(inst.allocator, &poolInfo, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create memory pool!");
+    }
+    vmaSetPoolName(inst.allocator, pool, categoryNames[static_cast<uint32_t>(c)]);
+    p.byMemoryType[memoryTypeIndex] = pool;
+    return pool;
+}
+
+void memory_pools::selectPool(category c, const VkBufferCreateInfo& bufferInfo, VmaAllocationCreateInfo& allocInfo)
+{
+    allocInfo.pool = VK_NULL_HANDLE;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndexForBufferInfo(inst.allocator, &bufferInfo, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+        throw std::runtime_error("failed to find a memory type for buffer!");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    allocInfo.pool = getPool(c, memoryTypeIndex);
+}
+
+void memory_pools::selectPool(category c, const VkImageCreateInfo& imageInfo, VmaAllocationCreateInfo& allocInfo)
+{
+    allocInfo.pool = VK_NULL_HANDLE;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndexForImageInfo(inst.allocator, &imageInfo, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+        throw std::runtime_error("failed to find a memory type for image!");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    allocInfo.pool = getPool(c, memoryTypeIndex);
+}
+
+void memory_pools::selectPool(category c, const VkMemoryRequirements& requirements, VmaAllocationCreateInfo& allocInfo)
+{
+    allocInfo.pool = VK_NULL_HANDLE;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndex(inst.allocator, requirements.memoryTypeBits, &allocInfo, &memoryTypeIndex) != VK_SUCCESS) {
+        throw std::runtime_error("failed to find a memory type!");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    allocInfo.pool = getPool(c, memoryTypeIndex);
+}
+
+instance::svkbuffer memory_pools::createBuffer(category c, VkBufferCreateInfo bufferInfo, VmaAllocationCreateInfo allocInfo, VkDeviceSize size)
+{
+    selectPool(c, bufferInfo, allocInfo);
+    instance::svkbuffer buffer = inst.createBuffer(bufferInfo, allocInfo, size);
+    if (buffer.buff == VK_NULL_HANDLE) {
+        throw std::runtime_error("failed to allocate buffer from memory pool!");
+    }
+    checkCategory(c);
+    return buffer;
+}
+
+instance::svkimage memory_pools::createImage(category c, VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo)
+{
+    selectPool(c, imageInfo, allocInfo);
+    instance::svkimage image = inst.createImage(imageInfo, allocInfo);
+    if (image.image == VK_NULL_HANDLE) {
+        throw std::runtime_error("failed to allocate image from memory pool!");
+    }
+    checkCategory(c);
+    return image;
+}
+
+memory_pools::usage memory_pools::getUsageLocked(category c)
+{
+    pools& p = categories[static_cast<uint32_t>(c)];
+    usage u{};
+    u.budget = p.budget;
+    for (auto& [memoryTypeIndex, pool] : p.byMemoryType) {
+        VmaStatistics stats;
+        vmaGetPoolStatistics(inst.allocator, pool, &stats);
+        u.allocationBytes += stats.allocationBytes;
+        u.blockBytes += stats.blockBytes;
+        u.allocationCount += stats.allocationCount;
+    }
+    return u;
+}
+
+memory_pools::usage memory_pools::getUsage(category c)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return getUsageLocked(c);
+}
+
+bool memory_pools::fits(category c, VkDeviceSize size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    usage u = getUsageLocked(c);
+    return u.budget == 0 || u.allocationBytes + size <= u.budget;
+}
+
+std::vector<VmaBudget> memory_pools::getHeapBudgets()
+{
+    std::vector<VmaBudget> budgets(heapsWarned.size());
+    vmaGetHeapBudgets(inst.allocator, budgets.data());
+    return budgets;
+}
+
+void memory_pools::checkCategory(category c)
+{
+    //callbacks run unlocked, they are expected to free memory
+    usage u;
+    bool crossed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pools& p = categories[static_cast<uint32_t>(c)];
+        u = getUsageLocked(c);
+        peakAllocationBytes[static_cast<uint32_t>(c)] = std::max(peakAllocationBytes[static_cast<uint32_t>(c)], u.allocationBytes);
+        const bool over = p.budget > 0 && u.allocationBytes >= static_cast<VkDeviceSize>(p.budget * static_cast<double>(p.warnThreshold));
+        crossed = over && !p.warned;
+        p.warned = over;
+    }
+    if (crossed && onBudgetWarning != nullptr)
+        onBudgetWarning(c, u.allocationBytes, u.budget);
+}
+
+void memory_pools::checkBudgets()
+{
+    for (uint32_t i = 0; i < categoryCount; i++) {
+        checkCategory(static_cast<category>(i));
+    }
+
+    std::vector<VmaBudget> budgets = getHeapBudgets();
+    std::vector<uint32_t> crossed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint32_t heap = 0; heap < budgets.size(); heap++) {
+            const bool over = budgets[heap].budget > 0 &&
+                budgets[heap].usage >= static_cast<VkDeviceSize>(budgets[heap].budget * static_cast<double>(heapWarnThreshold));
+            if (over && !heapsWarned[heap])
+                crossed.push_back(heap);
+            heapsWarned[heap] = over;
+        }
+    }
+    if (onHeapBudgetWarning != nullptr) {
+        for (uint32_t heap : crossed) {
+            onHeapBudgetWarning(heap, budgets[heap].usage, budgets[heap].budget);
+        }
+    }
+}
+
+void memory_pools::update(uint32_t frameIndex)
+{
+    //with VK_EXT_memory_budget vma fetches the driver's numbers here
+    vmaSetCurrentFrameIndex(inst.allocator, frameIndex);
+    checkBudgets();
+}
+
+std::vector<VmaPool> memory_pools::getPools()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<VmaPool> all;
+    for (pools& p : categories) {
+        for (auto& [memoryTypeIndex, pool] : p.byMemoryType) {
+            all.push_back(pool);
+        }
+    }
+    return all;
+}
+
+//telemetry
+static float fragmentation(const VmaDetailedStatistics& stats)
+{
+    const VkDeviceSize freeBytes = stats.statistics.blockBytes - stats.statistics.allocationBytes;
+    if (freeBytes == 0 || stats.unusedRangeCount == 0)
+        return 0.0f;
+    return 1.0f - static_cast<float>(static_cast<double>(stats.unusedRangeSizeMax) / static_cast<double>(freeBytes));
+}
+
+static void addStatistics(VmaDetailedStatistics& total, const VmaDetailedStatistics& stats)
+{
+    total.statistics.blockCount += stats.statistics.blockCount;
+    total.statistics.allocationCount += stats.statistics.allocationCount;
+    total.statistics.blockBytes += stats.statistics.blockBytes;
+    total.statistics.allocationBytes += stats.statistics.allocationBytes;
+    total.unusedRangeCount += stats.unusedRangeCount;
+    total.unusedRangeSizeMax = std::max(total.unusedRangeSizeMax, stats.unusedRangeSizeMax);
+}
+
+void VKAPI_PTR memory_pools::deviceMemoryAllocated(VmaAllocator allocator, uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* userData)
+{
+    memory_pools* pools = static_cast<instance*>(userData)->memoryPools.get();
+    if (pools == nullptr)
+        return;
+    heapCounter& counter = pools->heapCounters[pools->heapOfType[memoryType]];
+    counter.allocations.fetch_add(1, std::memory_order_relaxed);
+    const VkDeviceSize current = counter.blockBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    VkDeviceSize peak = counter.peakBlockBytes.load(std::memory_order_relaxed);
+    while (current > peak && !counter.peakBlockBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {}
+}
+
+void VKAPI_PTR memory_pools::deviceMemoryFreed(VmaAllocator allocator, uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* userData)
+{
+    memory_pools* pools = static_cast<instance*>(userData)->memoryPools.get();
+    if (pools == nullptr)
+        return;
+    pools->heapCounters[pools->heapOfType[memoryType]].blockBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+memory_pools::report memory_pools::getReport()
+{
+    report r{};
+
+    VmaTotalStatistics total;
+    vmaCalculateStatistics(inst.allocator, &total);
+    r.blockBytes = total.total.statistics.blockBytes;
+    r.allocationBytes = total.total.statistics.allocationBytes;
+    r.allocationCount = total.total.statistics.allocationCount;
+
+    const VkPhysicalDeviceMemoryProperties* memoryProperties;
+    vmaGetMemoryProperties(inst.allocator, &memoryProperties);
+    std::vector<VmaBudget> budgets = getHeapBudgets();
+    for (uint32_t heap = 0; heap < memoryProperties->memoryHeapCount; heap++) {
+        const VmaDetailedStatistics& stats = total.memoryHeap[heap];
+        heapReport h{};
+        h.heap = heap;
+        h.size = memoryProperties->memoryHeaps[heap].size;
+        h.deviceLocal = (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+        h.budget = budgets[heap].budget;
+        h.usage = budgets[heap].usage;
+        h.blockBytes = stats.statistics.blockBytes;
+        h.allocationBytes = stats.statistics.allocationBytes;
+        h.blockCount = stats.statistics.blockCount;
+        h.allocationCount = stats.statistics.allocationCount;
+        h.fragmentation = fragmentation(stats);
+        h.peakBlockBytes = heapCounters[heap].peakBlockBytes.load(std::memory_order_relaxed);
+        h.deviceMemoryAllocations = heapCounters[heap].allocations.load(std::memory_order_relaxed);
+        r.heaps.push_back(h);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < categoryCount; i++) {
+        VmaDetailedStatistics stats{};
+        for (auto& [memoryTypeIndex, pool] : categories[i].byMemoryType) {
+            VmaDetailedStatistics poolStats;
+            vmaCalculatePoolStatistics(inst.allocator, pool, &poolStats);
+            addStatistics(stats, poolStats);
+        }
+        peakAllocationBytes[i] = std::max(peakAllocationBytes[i], stats.statistics.allocationBytes);
+
+        categoryReport c{};
+        c.c = static_cast<category>(i);
+        c.name = categoryNames[i];
+        c.budget = categories[i].budget;
+        c.blockBytes = stats.statistics.blockBytes;
+        c.allocationBytes = stats.statistics.allocationBytes;
+        c.blockCount = stats.statistics.blockCount;
+        c.allocationCount = stats.statistics.allocationCount;
+        c.fragmentation = fragmentation(stats);
+        c.peakAllocationBytes = peakAllocationBytes[i];
+        r.categories.push_back(c);
+    }
+
+    return r;
+}
+
+std::string memory_pools::dumpJson(bool detailedMap)
+{
+    report r = getReport();
+
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"memoryBudget\": " << (inst.hasMemoryBudget() ? "true" : "false") << ",\n";
+    json << "  \"total\": { \"blockBytes\": " << r.blockBytes
+         << ", \"allocationBytes\": " << r.allocationBytes
+         << ", \"allocationCount\": " << r.allocationCount << " },\n";
+
+    json << "  \"heaps\": [\n";
+    for (size_t i = 0; i < r.heaps.size(); i++) {
+        const heapReport& h = r.heaps[i];
+        json << "    { \"heap\": " << h.heap
+             << ", \"size\": " << h.size
+             << ", \"deviceLocal\": " << (h.deviceLocal ? "true" : "false")
+             << ", \"budget\": " << h.budget
+             << ", \"usage\": " << h.usage
+             << ", \"blockBytes\": " << h.blockBytes
+             << ", \"allocationBytes\": " << h.allocationBytes
+             << ", \"blockCount\": " << h.blockCount
+             << ", \"allocationCount\": " << h.allocationCount
+             << ", \"fragmentation\": " << h.fragmentation
+             << ", \"peakBlockBytes\": " << h.peakBlockBytes
+             << ", \"deviceMemoryAllocations\": " << h.deviceMemoryAllocations
+             << " }" << (i + 1 < r.heaps.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+
+    json << "  \"categories\": [\n";
+    for (size_t i = 0; i < r.categories.size(); i++) {
+        const categoryReport& c = r.categories[i];
+        json << "    { \"name\": \"" << c.name << "\""
+             << ", \"budget\": " << c.budget
+             << ", \"blockBytes\": " << c.blockBytes
+             << ", \"allocationBytes\": " << c.allocationBytes
+             << ", \"blockCount\": " << c.blockCount
+             << ", \"allocationCount\": " << c.allocationCount
+             << ", \"fragmentation\": " << c.fragmentation
+             << ", \"peakAllocationBytes\": " << c.peakAllocationBytes
+             << " }" << (i + 1 < r.categories.size() ? "," : "") << "\n";
+    }
+    json << "  ],\n";
+
+    char* vmaStats = nullptr;
+    vmaBuildStatsString(inst.allocator, &vmaStats, detailedMap ? VK_TRUE : VK_FALSE);
+    json << "  \"vma\": " << vmaStats << "\n";
+    vmaFreeStatsString(inst.allocator, vmaStats);
+
+    json << "}\n";
+    return json.str();
+}
+
+void memory_pools::dumpJson(const std::string& path, bool detailedMap)
+{
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open memory dump file!");
+    }
+    file << dumpJson(detailedMap);
+    if (!file.good()) {
+        throw std::runtime_error("failed to write memory dump file!");
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_MEMORY_CPP
@@ -0,0 +1,139 @@
+#ifndef SVKLIB_MEMORY_HPP
+#define SVKLIB_MEMORY_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//separate vma pools per kind of resource so each kind can be budgeted and measured on its own
+//a category gets one pool per memory type its resources land in, created on first use
+//budgets are soft, nothing is refused, onBudgetWarning fires once when a category crosses
+//warnThreshold of its budget and again only after it dropped back below it
+class memory_pools {
+public:
+    memory_pools(instance& inst);
+    ~memory_pools(); //every allocation made from the pools must be freed
+    memory_pools(const memory_pools&) = delete;
+    memory_pools& operator=(const memory_pools&) = delete;
+
+    enum class category : uint32_t { renderTarget = 0, texture = 1, geometry = 2, staging = 3 };
+    static constexpr uint32_t categoryCount = 4;
+
+    //bytes, 0 is unlimited
+    void setBudget(category c, VkDeviceSize budget, float warnThreshold = 0.9f);
+    VkDeviceSize getBudget(category c);
+
+    //sets allocInfo.pool to the pool of c for the memory type vma would pick for the resource
+    void selectPool(category c, const VkBufferCreateInfo& bufferInfo, VmaAllocationCreateInfo& allocInfo);
+    void selectPool(category c, const VkImageCreateInfo& imageInfo, VmaAllocationCreateInfo& allocInfo);
+    //for memory shared by several resources (vmaAllocateMemory)
+    void selectPool(category c, const VkMemoryRequirements& requirements, VmaAllocationCreateInfo& allocInfo);
+
+    //instance::createBuffer/createImage from the pool of c, throws when the allocation fails
+    instance::svkbuffer createBuffer(category c, VkBufferCreateInfo bufferInfo, VmaAllocationCreateInfo allocInfo, VkDeviceSize size);
+    instance::svkimage createImage(category c, VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo);
+
+    struct usage {
+        VkDeviceSize allocationBytes = 0; //in use by resources
+        VkDeviceSize blockBytes = 0; //device memory held by the pools
+        uint32_t allocationCount = 0;
+        VkDeviceSize budget = 0;
+    };
+    usage getUsage(category c);
+    //whether size more bytes keep c within its budget
+    bool fits(category c, VkDeviceSize size);
+
+    //per memory heap, from VK_EXT_memory_budget when the device has it, otherwise estimated by vma
+    std::vector<VmaBudget> getHeapBudgets();
+
+    std::function<void(category c, VkDeviceSize used, VkDeviceSize budget)> onBudgetWarning = nullptr;
+    //a heap crossed the warning threshold of what the driver grants this process
+    std::function<void(uint32_t heap, VkDeviceSize used, VkDeviceSize budget)> onHeapBudgetWarning = nullptr;
+    float heapWarnThreshold = 0.9f;
+
+    //fires the callbacks of categories and heaps that crossed their threshold
+    void checkBudgets();
+    //once per frame, refreshes the heap budgets from the driver then checks them
+    void update(uint32_t frameIndex);
+
+    //every pool, for code that walks them (defragmenter)
+    std::vector<VmaPool> getPools();
+
+    //telemetry, fragmentation is 1 - largest free range / free bytes inside the blocks (0 is none)
+    struct heapReport {
+        uint32_t heap = 0;
+        VkDeviceSize size = 0;
+        bool deviceLocal = false;
+        VkDeviceSize budget = 0; //what the driver grants this process, see getHeapBudgets
+        VkDeviceSize usage = 0; //process wide, including memory not allocated through vma
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocationBytes = 0;
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        float fragmentation = 0.0f;
+        VkDeviceSize peakBlockBytes = 0; //since the allocator was created
+        uint64_t deviceMemoryAllocations = 0; //vkAllocateMemory calls since the allocator was created
+    };
+    struct categoryReport {
+        category c;
+        const char* name;
+        VkDeviceSize budget = 0;
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocationBytes = 0;
+        uint32_t blockCount = 0;
+        uint32_t allocationCount = 0;
+        float fragmentation = 0.0f;
+        VkDeviceSize peakAllocationBytes = 0; //highest seen by checkBudgets or a pooled allocation
+    };
+    struct report {
+        std::vector<heapReport> heaps;
+        std::vector<categoryReport> categories;
+        VkDeviceSize blockBytes = 0;
+        VkDeviceSize allocationBytes = 0;
+        uint32_t allocationCount = 0;
+    };
+    //walks every allocation (vmaCalculateStatistics), not meant for every frame
+    report getReport();
+    //getReport() followed by vmaBuildStatsString under "vma", keys are in a fixed order so dumps
+    //of two builds diff cleanly, detailedMap adds every allocation and free range of every block
+    std::string dumpJson(bool detailedMap = false);
+    //throws when the file can not be written
+    void dumpJson(const std::string& path, bool detailedMap);
+
+    //vma device memory callbacks, installed by instance::createAllocator
+    static void VKAPI_PTR deviceMemoryAllocated(VmaAllocator allocator, uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* userData);
+    static void VKAPI_PTR deviceMemoryFreed(VmaAllocator allocator, uint32_t memoryType, VkDeviceMemory memory, VkDeviceSize size, void* userData);
+
+private:
+    instance& inst;
+
+    struct pools {
+        std::unordered_map<uint32_t,VmaPool> byMemoryType;
+        VkDeviceSize budget = 0;
+        float warnThreshold = 0.9f;
+        bool warned = false;
+    };
+    std::array<pools,categoryCount> categories;
+    std::array<VkDeviceSize,categoryCount> peakAllocationBytes{};
+    std::vector<bool> heapsWarned;
+
+    //indexed by heap, written from whichever thread allocates
+    struct heapCounter {
+        std::atomic<VkDeviceSize> blockBytes{0};
+        std::atomic<VkDeviceSize> peakBlockBytes{0};
+        std::atomic<uint64_t> allocations{0};
+    };
+    std::array<heapCounter,VK_MAX_MEMORY_HEAPS> heapCounters;
+    std::array<uint32_t,VK_MAX_MEMORY_TYPES> heapOfType{};
+    std::mutex mutex;
+
+    VmaPool getPool(category c, uint32_t memoryTypeIndex); //expects mutex held
+    usage getUsageLocked(category c);
+    void checkCategory(category c);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_MEMORY_HPP
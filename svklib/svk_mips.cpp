@@ -0,0 +1,195 @@
+#ifndef SVKLIB_MIPS_CPP
+#define SVKLIB_MIPS_CPP
+
+#include "svk_mips.hpp"
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SVKLIB_MIPS_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define SVKLIB_MIPS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace svklib {
+
+//8 bit <-> 12 bit linear, 4 12 bit values sum without overflowing 16 bit lanes
+struct mipTables {
+    uint16_t fromSrgb[256];
+    uint16_t fromUnorm[256];
+    uint8_t toSrgb[4096];
+    uint8_t toUnorm[4096];
+
+    mipTables() {
+        for (int i = 0; i < 256; i++) {
+            const double c = i / 255.0;
+            const double linear = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            fromSrgb[i] = static_cast<uint16_t>(linear * 4095.0 + 0.5);
+            fromUnorm[i] = static_cast<uint16_t>((i * 4095 + 127) / 255);
+        }
+        for (int i = 0; i < 4096; i++) {
+            const double linear = i / 4095.0;
+            const double c = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+            toSrgb[i] = static_cast<uint8_t>(std::clamp(c * 255.0 + 0.5, 0.0, 255.0));
+            toUnorm[i] = static_cast<uint8_t>((i * 255 + 2047) / 4095);
+        }
+    }
+};
+
+static const mipTables& tables()
+{
+    static const mipTables t;
+    return t;
+}
+
+bool mip_generator::supports(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool mip_generator::isSrgb(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+uint32_t mip_generator::fullChain(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    for (uint32_t extent = std::max(width, height); extent > 1; extent >>= 1)
+        levels++;
+    return levels;
+}
+
+VkDeviceSize mip_generator::pyramidSize(uint32_t width, uint32_t height, uint32_t levels)
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < levels; level++)
+        size += static_cast<VkDeviceSize>(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+    return size;
+}
+
+std::vector<VkBufferImageCopy> mip_generator::regions(uint32_t width, uint32_t height, uint32_t levels)
+{
+    std::vector<VkBufferImageCopy> result(levels);
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < levels; level++) {
+        const uint32_t levelWidth = std::max(width >> level, 1u);
+        const uint32_t levelHeight = std::max(height >> level, 1u);
+        VkBufferImageCopy& region = result[level];
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = {levelWidth, levelHeight, 1};
+        offset += static_cast<VkDeviceSize>(levelWidth) * levelHeight * 4;
+    }
+    return result;
+}
+
+//one row of dst from two rows of src, 4 channels of 12 bit linear per texel
+//odd widths drop the last column like a blit, a width of 1 repeats it
+static void downsampleRow(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, uint32_t srcWidth, uint32_t dstWidth)
+{
+    uint32_t x = 0;
+#if defined(__AVX2__)
+    const __m256i round256 = _mm256_set1_epi16(2);
+    for (; x + 4 <= dstWidth; x += 4) {
+        const __m256i v0 = _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8)));
+        const __m256i v1 = _mm256_add_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8 + 16)),
+                                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8 + 16)));
+        //pairs of horizontal neighbours, unpack works per 128 bit lane so the texels come out as 0 2 1 3
+        __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(v0, v1), _mm256_unpackhi_epi64(v0, v1));
+        sum = _mm256_permute4x64_epi64(sum, 0xD8);
+        sum = _mm256_srli_epi16(_mm256_add_epi16(sum, round256), 2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), sum);
+    }
+#endif
+#if defined(SVKLIB_MIPS_SSE2)
+    const __m128i round128 = _mm_set1_epi16(2);
+    for (; x + 2 <= dstWidth; x += 2) {
+        const __m128i v0 = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8)));
+        const __m128i v1 = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 8)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 8)));
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(v0, v1), _mm_unpackhi_epi64(v0, v1));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, round128), 2);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), sum);
+    }
+#elif defined(SVKLIB_MIPS_NEON)
+    for (; x + 2 <= dstWidth; x += 2) {
+        const uint16x8_t v0 = vaddq_u16(vld1q_u16(row0 + x * 8), vld1q_u16(row1 + x * 8));
+        const uint16x8_t v1 = vaddq_u16(vld1q_u16(row0 + x * 8 + 8), vld1q_u16(row1 + x * 8 + 8));
+        const uint16x8_t sum = vaddq_u16(vcombine_u16(vget_low_u16(v0), vget_low_u16(v1)),
+                                         vcombine_u16(vget_high_u16(v0), vget_high_u16(v1)));
+        vst1q_u16(dst + x * 4, vrshrq_n_u16(sum, 2));
+    }
+#endif
+    for (; x < dstWidth; x++) {
+        const uint32_t x0 = x * 2;
+        const uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+        for (uint32_t c = 0; c < 4; c++) {
+            const uint32_t sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+            dst[x * 4 + c] = static_cast<uint16_t>((sum + 2) >> 2);
+        }
+    }
+}
+
+void mip_generator::build(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levels, bool srgb, uint8_t* out)
+{
+    const mipTables& t = tables();
+    //alpha is always linear
+    const uint16_t* from[4] = {srgb ? t.fromSrgb : t.fromUnorm, srgb ? t.fromSrgb : t.fromUnorm, srgb ? t.fromSrgb : t.fromUnorm, t.fromUnorm};
+    const uint8_t* to[4] = {srgb ? t.toSrgb : t.toUnorm, srgb ? t.toSrgb : t.toUnorm, srgb ? t.toSrgb : t.toUnorm, t.toUnorm};
+
+    const size_t baseSize = static_cast<size_t>(width) * height * 4;
+    memcpy(out, rgba, baseSize);
+    out += baseSize;
+    if (levels <= 1)
+        return;
+
+    std::vector<uint16_t> current(baseSize);
+    for (size_t i = 0; i < baseSize; i++)
+        current[i] = from[i & 3][rgba[i]];
+    std::vector<uint16_t> next(static_cast<size_t>(std::max(width / 2, 1u)) * std::max(height / 2, 1u) * 4);
+
+    uint32_t srcWidth = width;
+    uint32_t srcHeight = height;
+    for (uint32_t level = 1; level < levels; level++) {
+        const uint32_t dstWidth = std::max(srcWidth / 2, 1u);
+        const uint32_t dstHeight = std::max(srcHeight / 2, 1u);
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            const uint16_t* row0 = current.data() + static_cast<size_t>(y * 2) * srcWidth * 4;
+            const uint16_t* row1 = current.data() + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+            downsampleRow(row0, row1, next.data() + static_cast<size_t>(y) * dstWidth * 4, srcWidth, dstWidth);
+        }
+
+        const size_t levelSize = static_cast<size_t>(dstWidth) * dstHeight * 4;
+        for (size_t i = 0; i < levelSize; i++)
+            out[i] = to[i & 3][next[i]];
+        out += levelSize;
+
+        std::swap(current, next);
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_MIPS_CPP
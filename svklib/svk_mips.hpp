@@ -0,0 +1,27 @@
+#ifndef SVKLIB_MIPS_HPP
+#define SVKLIB_MIPS_HPP
+
+#include "svk_forward_declarations.hpp"
+
+namespace svklib {
+
+//cpu mip pyramids of 4 byte rgba/bgra images, levels are box filtered in 12 bit linear space through
+//lookup tables so srgb formats are filtered gamma correct, the filter uses AVX2, SSE2 or NEON when built with them
+//levels are tightly packed one after the other, level 0 first
+class mip_generator {
+public:
+    //R8G8B8A8 and B8G8R8A8, unorm or srgb
+    static bool supports(VkFormat format);
+    static bool isSrgb(VkFormat format);
+    static uint32_t fullChain(uint32_t width, uint32_t height);
+    static VkDeviceSize pyramidSize(uint32_t width, uint32_t height, uint32_t levels);
+
+    //writes pyramidSize() bytes to out, level 0 is a copy of rgba, out is only written so it may be staging memory
+    static void build(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t levels, bool srgb, uint8_t* out);
+    //one copy region per level of a pyramid written by build(), offsets are relative to its start
+    static std::vector<VkBufferImageCopy> regions(uint32_t width, uint32_t height, uint32_t levels);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_MIPS_HPP
@@ -19,9 +19,6 @@ pipeline::pipeline(instance& inst,swapchain& swapChain, BuildInfo* builderInfo,
     : inst(inst),swapChain(swapChain),builderInfo(builderInfo),pipelineLayout(pipelineLayout),
       renderPass(renderPass),graphicsPipeline(graphicsPipeline)
 {
-    createDepthResources();
-    createColorResources();
-    createFramebuffers();
 }
 
 pipeline::pipeline(instance& inst, swapchain& swapChain)
@@ -32,7 +29,7 @@ pipeline::pipeline(instance& inst, swapchain& swapChain)
 
 pipeline::~pipeline() {
     
-    destroyFramebuffers();
+    swapChain.releaseFramebuffers(renderPass);
     vkDestroyPipeline(inst.device, graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(inst.device, pipelineLayout, nullptr);
     vkDestroyRenderPass(inst.device, renderPass, nullptr);
@@ -361,13 +358,14 @@ void pipeline::builder::buildPipelineImpl(VkPipeline oldPipeline) {
 void pipeline::builder::buildPipeline(VkPipeline oldPipeline, pipeline* pipeline) {
     buildPipelineImpl(oldPipeline);
 
+    //the swapchain caches framebuffers by render pass, the old pass must not be in use anymore
+    if (pipeline->renderPass != VK_NULL_HANDLE)
+        pipeline->swapChain.releaseFramebuffers(pipeline->renderPass);
+
     pipeline->builderInfo = std::unique_ptr<BuildInfo>(info);
     pipeline->pipelineLayout = pipelineLayout;
     pipeline->renderPass = renderPass;
     pipeline->graphicsPipeline = graphicsPipeline;
-    pipeline->createDepthResources();
-    pipeline->createColorResources();
-    pipeline->createFramebuffers();
 }
 
 pipeline pipeline::builder::buildPipeline(VkPipeline oldPipeline) {
@@ -469,7 +467,8 @@ void pipeline::builder::createRenderPass() { //TODO abstractions
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    //offscreen targets are copied into readback buffers instead of presented
+    colorAttachmentResolve.finalLayout = swapChain.isOffscreen() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentResolveRef{};
     colorAttachmentResolveRef.attachment = 2;
@@ -509,108 +508,27 @@ void pipeline::builder::createRenderPass() { //TODO abstractions
 
 void pipeline::reCreateSwapChain() {
 
-    int width = 0, height = 0;
-    glfwGetFramebufferSize(inst.win.win, &width, &height);
-    while (width == 0 || height == 0) {
-        glfwGetFramebufferSize(inst.win.win, &width, &height);
-        glfwWaitEvents();
+    if (!inst.isHeadless()) {
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(inst.win->win, &width, &height);
+        while (width == 0 || height == 0) {
+            glfwGetFramebufferSize(inst.win->win, &width, &height);
+            glfwWaitEvents();
+        }
     }
 
     inst.waitForDeviceIdle();
-    
-    destroyFramebuffers();
 
+    //the swapchain drops its attachments and framebuffers, every pipeline using it picks up the new ones
     swapChain.recreateSwapChain();
 
-    createDepthResources();
-    createColorResources();
-    createFramebuffers();
-
 }
 
 // framebuffers
 
-void pipeline::createDepthResources()
+VkFramebuffer pipeline::getFramebuffer(uint32_t imageIndex)
 {
-    VkImageCreateInfo imageCreateInfo{};
-    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageCreateInfo.extent.width = swapChain.swapChainExtent.width;
-    imageCreateInfo.extent.height = swapChain.swapChainExtent.height;
-    imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.mipLevels = 1;
-    imageCreateInfo.arrayLayers = 1;
-    imageCreateInfo.format = inst.findDepthFormat();
-    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-    imageCreateInfo.samples = swapChain.samples;
-    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VmaAllocationCreateInfo allocCreateInfo{};
-    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-    depthImage = inst.createImage(imageCreateInfo, allocCreateInfo);
-    inst.createImageView(depthImage, imageCreateInfo.format, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    inst.transitionImageLayout(depthImage, imageCreateInfo.format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-}
-
-void pipeline::createColorResources() {
-    VkImageCreateInfo imageCreateInfo{};
-    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageCreateInfo.extent.width = swapChain.swapChainExtent.width;
-    imageCreateInfo.extent.height = swapChain.swapChainExtent.height;
-    imageCreateInfo.extent.depth = 1;
-    imageCreateInfo.mipLevels = 1;
-    imageCreateInfo.arrayLayers = 1;
-    imageCreateInfo.format = swapChain.swapChainImageFormat; 
-    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    imageCreateInfo.samples = swapChain.samples;
-    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VmaAllocationCreateInfo allocCreateInfo{};
-    allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-
-    colorImage = inst.createImage(imageCreateInfo, allocCreateInfo);
-    inst.createImageView(colorImage, imageCreateInfo.format, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-}
-
-void pipeline::createFramebuffers()
-{
-    frameBuffers.resize(swapChain.swapChainImageViews.size());
-
-    for (size_t i = 0; i < swapChain.swapChainImageViews.size(); i++) {
-        std::array<VkImageView,3> attachments = {
-            colorImage.view.value(),
-            depthImage.view.value(),
-            swapChain.swapChainImageViews[i],
-        };
-
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebufferInfo.renderPass = renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        framebufferInfo.pAttachments = attachments.data();
-        framebufferInfo.width = swapChain.swapChainExtent.width;
-        framebufferInfo.height = swapChain.swapChainExtent.height;
-        framebufferInfo.layers = 1;
-
-        if (vkCreateFramebuffer(inst.device, &framebufferInfo, nullptr, &frameBuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create framebuffer!");
-        }
-    }
-}
-
-void pipeline::destroyFramebuffers() {
-    for (auto &framebuffer : frameBuffers) {
-        vkDestroyFramebuffer(inst.device, framebuffer, nullptr);
-    }
-    inst.destroyImage(depthImage);
-    inst.destroyImage(colorImage);
+    return swapChain.getFramebuffer(renderPass, imageIndex);
 }
 
 // framebuffers end
@@ -636,6 +554,14 @@ pipeline::~pipeline() {
     vkDestroyPipeline(inst.device, computePipeline, nullptr);
 }
 
+void pipeline::recordDispatch(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    for (uint32_t i = 0; i < descriptorSets.size(); i++) {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, i, 1, &descriptorSets[i][frame], 0, nullptr);
+    }
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+}
+
 pipeline::builder pipeline::builder::begin(instance& inst) {
     return builder(inst);
 }
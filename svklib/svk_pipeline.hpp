@@ -63,21 +63,16 @@ namespace graphics {
         swapchain& swapChain;
 
         //pipeline
-        VkPipelineLayout pipelineLayout;
-        VkRenderPass renderPass;
-        VkPipeline graphicsPipeline;
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkPipeline graphicsPipeline = VK_NULL_HANDLE;
         //pipeline end
 
         void reCreateSwapChain();
         
         //framebuffers
-        instance::svkimage depthImage;
-        void createDepthResources();
-        instance::svkimage colorImage;
-        void createColorResources();
-        std::vector<VkFramebuffer> frameBuffers{};
-        void createFramebuffers();
-        void destroyFramebuffers();
+        //attachments and framebuffers belong to the swapchain, shared with every pipeline rendering into it
+        VkFramebuffer getFramebuffer(uint32_t imageIndex);
         //framebuffers end
 
         
@@ -88,6 +83,8 @@ namespace graphics {
         std::vector<VkDeviceSize> vertexBufferOffsets;
         IndexBufferInfo indexBufferInfo;
         std::vector<std::vector<VkDescriptorSet>> descriptorSets;
+        //per descriptor set, one offset per dynamic binding (frame_allocator::allocation::dynamicOffset)
+        std::vector<std::vector<uint32_t>> dynamicOffsets;
         
         void updatePushConstantData(void* data);
 
@@ -177,6 +174,9 @@ namespace compute {
 
             std::vector<std::vector<VkDescriptorSet>> descriptorSets;
 
+            //binds the pipeline and the descriptor sets of a frame, then dispatches
+            void recordDispatch(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+
         private:
             instance& inst;
             
@@ -5,6 +5,11 @@
 
 #include "svk_swapchain.hpp"
 #include "svk_pipeline.hpp"
+#include "svk_threadpool.hpp"
+#include "svk_frame_allocator.hpp"
+#include "svk_defrag.hpp"
+#include "svk_memory.hpp"
+#include "svk_deletion.hpp"
 
 #include "svk_window.hpp"
 
@@ -12,6 +17,87 @@ namespace svklib {
 
 namespace queue {
 
+timeline::timeline(instance& inst, uint64_t initialValue)
+    : inst(inst)
+{
+    if (!inst.hasTimelineSemaphores()) {
+        throw std::runtime_error("timeline semaphores are not supported (requires Vulkan 1.2)");
+    }
+
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = initialValue;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    if (vkCreateSemaphore(inst.device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create timeline semaphore!");
+    }
+}
+
+timeline::~timeline()
+{
+    vkDestroySemaphore(inst.device, semaphore, nullptr);
+}
+
+uint64_t timeline::value()
+{
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(inst.device, semaphore, &value);
+    return value;
+}
+
+void timeline::wait(uint64_t value)
+{
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    vkWaitSemaphores(inst.device, &waitInfo, UINT64_MAX);
+}
+
+void timeline::signal(uint64_t value)
+{
+    VkSemaphoreSignalInfo signalInfo{};
+    signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+    signalInfo.semaphore = semaphore;
+    signalInfo.value = value;
+    vkSignalSemaphore(inst.device, &signalInfo);
+}
+
+void submitTimeline(instance::svkqueue& queue, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers,
+                    const timelineWait* wait, VkSemaphore semaphore, uint64_t signalValue, VkFence fence)
+{
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &semaphore;
+
+    if (wait != nullptr) {
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &wait->value;
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &wait->semaphore;
+        submitInfo.pWaitDstStageMask = &wait->stage;
+    }
+
+    if (queue.submit(1,&submitInfo,fence) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit command buffer!");
+    }
+}
+
 sync::sync(instance& inst, const int count)
     : inst(inst), count(count)
 {
@@ -37,17 +123,31 @@ VkResult sync::acquireNextImage(const int frame, VkSwapchainKHR swapChain, uint3
     return result;
 }
 
-void sync::submitFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue) 
+void sync::submitFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue, const timelineWait* computeWait) 
 {
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphore[frame] };
-    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    VkSemaphore waitSemaphores[] = { imageAvailableSemaphore[frame], VK_NULL_HANDLE };
+    VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0 };
     submitInfo.waitSemaphoreCount = 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
 
+    //binary semaphore values are ignored
+    uint64_t waitValues[] = { 0, 0 };
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    if (computeWait != nullptr) {
+        waitSemaphores[1] = computeWait->semaphore;
+        waitStages[1] = computeWait->stage;
+        waitValues[1] = computeWait->value;
+        submitInfo.waitSemaphoreCount = 2;
+        timelineInfo.waitSemaphoreValueCount = 2;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        submitInfo.pNext = &timelineInfo;
+    }
+
     submitInfo.commandBufferCount = commandBufferCount;
     submitInfo.pCommandBuffers = commandBuffers;
 
@@ -60,6 +160,29 @@ void sync::submitFrame(const int frame, const uint32_t commandBufferCount, VkCom
     }
 }
 
+void sync::submitOffscreenFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue, const timelineWait* computeWait)
+{
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    if (computeWait != nullptr) {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &computeWait->semaphore;
+        submitInfo.pWaitDstStageMask = &computeWait->stage;
+        timelineInfo.waitSemaphoreValueCount = 1;
+        timelineInfo.pWaitSemaphoreValues = &computeWait->value;
+        submitInfo.pNext = &timelineInfo;
+    }
+
+    if (queue.submit(1,&submitInfo,inFlightFence[frame]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit command buffer!");
+    }
+}
+
 VkResult sync::presentFrame(const int frame, const uint32_t imageIndex, VkSwapchainKHR swapChain, instance::svkqueue &queue)
 {
     VkPresentInfoKHR presentInfo{};
@@ -119,12 +242,23 @@ void sync::destroySyncObjects()
 
 
 renderer::renderer(instance &inst, swapchain& swap, graphics::pipeline &pipe) 
-    : inst(inst), swap(swap), pipe(pipe), sync(inst, swap.swapChainImages.size())
+    : inst(inst), swap(swap), pipe(pipe), sync(inst, swap.swapChainImages.size()),
+      pendingReadbacks(swap.framesInFlight, 0)
 {}
 
-renderer::~renderer() = default;
+renderer::~renderer() {
+    if (replayCommandPool != VK_NULL_HANDLE) {
+        inst.graphicsQueue.waitIdle();
+        inst.destroyCommandPool(replayCommandPool);
+    }
+    if (computeCommandPool != VK_NULL_HANDLE) {
+        if (computeTimeline)
+            computeTimeline->wait(computeValue);
+        inst.destroyCommandPool(computeCommandPool);
+    }
+}
 
-void renderer::recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+void renderer::recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool parallelChunks) {
     VkCommandBufferBeginInfo beginInfo{};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     beginInfo.flags = 0; // Optional
@@ -137,7 +271,7 @@ void renderer::recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t i
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = pipe.renderPass;
-    renderPassInfo.framebuffer = pipe.frameBuffers[imageIndex];
+    renderPassInfo.framebuffer = pipe.getFramebuffer(imageIndex);
     renderPassInfo.renderArea.offset = { 0, 0 };
     renderPassInfo.renderArea.extent = pipe.swapChain.swapChainExtent;
 
@@ -148,21 +282,54 @@ void renderer::recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t i
     renderPassInfo.clearValueCount = clearColor.size();
     renderPassInfo.pClearValues = clearColor.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.graphicsPipeline);
-
-    //dynamic states
+    const bool chunks = recordChunk != nullptr && chunkCount > 0;
+    const bool secondary = chunks && parallelChunks;
 
     // pipe.viewports.clear();
     // pipe.buildViewport(static_cast<float>(pipe.swapChain.swapChainExtent.width),static_cast<float>(pipe.swapChain.swapChainExtent.height));
     pipe.builderInfo->viewports[0].width = static_cast<float>(pipe.swapChain.swapChainExtent.width);
     pipe.builderInfo->viewports[0].height = static_cast<float>(pipe.swapChain.swapChainExtent.height);
-    vkCmdSetViewport(commandBuffer, 0, pipe.builderInfo->viewports.size(), pipe.builderInfo->viewports.data());
-
     // pipe.scissors.clear();
     // pipe.buildScissor({0, 0}, pipe.swapChain.swapChainExtent);
     pipe.builderInfo->scissors[0].extent = pipe.swapChain.swapChainExtent;
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+    if (secondary) {
+        recordChunks(commandBuffer, imageIndex);
+    } else {
+        recordDrawState(commandBuffer, currentFrame);
+
+        if (chunks) {
+            for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                recordChunk(commandBuffer, chunk, currentFrame);
+            }
+        } else {
+            // vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            vkCmdDrawIndexed(commandBuffer, pipe.indexBufferInfo.count, 1, pipe.indexBufferInfo.firstIndex, pipe.indexBufferInfo.vertexOffset, 0);
+        }
+    }
+
+    //end commandBuffer
+
+    vkCmdEndRenderPass(commandBuffer);
+
+    if (swap.isOffscreen()) {
+        recordReadback(commandBuffer, imageIndex);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+
+//state is not inherited by secondary command buffers, so every chunk binds it again
+//only reads the pipeline, safe to call from several workers at once
+void renderer::recordDrawState(VkCommandBuffer commandBuffer, uint32_t frame) {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipe.graphicsPipeline);
+
+    //dynamic states
+    vkCmdSetViewport(commandBuffer, 0, pipe.builderInfo->viewports.size(), pipe.builderInfo->viewports.data());
     vkCmdSetScissor(commandBuffer, 0, pipe.builderInfo->scissors.size(), pipe.builderInfo->scissors.data());
 
     //bind vertex buffers
@@ -176,28 +343,104 @@ void renderer::recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t i
     }
 
     for (uint32_t i = 0; i < pipe.builderInfo->descriptorSetLayouts.size(); i++) {
-        vkCmdBindDescriptorSets(commandBuffer,VK_PIPELINE_BIND_POINT_GRAPHICS,pipe.pipelineLayout,0,1,&pipe.descriptorSets[i][currentFrame],0,nullptr);
+        const uint32_t dynamicOffsetCount = i < pipe.dynamicOffsets.size() ? static_cast<uint32_t>(pipe.dynamicOffsets[i].size()) : 0;
+        vkCmdBindDescriptorSets(commandBuffer,VK_PIPELINE_BIND_POINT_GRAPHICS,pipe.pipelineLayout,0,1,&pipe.descriptorSets[i][frame],
+            dynamicOffsetCount,dynamicOffsetCount > 0 ? pipe.dynamicOffsets[i].data() : nullptr);
     }
 
     //push constant
     if (pipe.pushConstantData != nullptr && pipe.pushConstantRange.has_value()) {
         vkCmdPushConstants(commandBuffer, pipe.pipelineLayout, pipe.pushConstantRange.value().stageFlags, pipe.pushConstantRange.value().offset, pipe.pushConstantRange.value().size, pipe.pushConstantData);
     }
+}
 
-    // vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-    vkCmdDrawIndexed(commandBuffer, pipe.indexBufferInfo.count, 1, 0, 0, 0);
-
-    //end commandBuffer
+//shared by the caller and the helpers, a helper that starts after the last chunk only touches the counters
+struct renderer::chunkJob {
+    renderer* self;
+    VkCommandBufferInheritanceInfo inheritanceInfo;
+    uint32_t frame;
+    uint32_t chunkCount;
+    std::vector<VkCommandBuffer> secondaries;
+    std::vector<std::exception_ptr> errors;
+    std::atomic<uint32_t> nextChunk{0};
+    std::atomic<uint32_t> doneChunks{0};
+};
+
+void renderer::recordClaimedChunks(chunkJob& j) {
+    for (;;) {
+        const uint32_t chunk = j.nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (chunk >= j.chunkCount)
+            return;
+
+        //exceptions must not escape into the pool, the chunk has to be counted either way
+        try {
+            //frame pools are per thread, so threads never share a pool
+            VkCommandBuffer secondary = j.self->inst.getFrameCommandBuffer(j.frame, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+            VkCommandBufferBeginInfo beginInfo{};
+            beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = &j.inheritanceInfo;
+
+            if (vkBeginCommandBuffer(secondary, &beginInfo) != VK_SUCCESS) {
+                throw std::runtime_error("failed to begin recording secondary command buffer!");
+            }
+
+            j.self->recordDrawState(secondary, j.frame);
+
+            j.self->recordChunk(secondary, chunk, j.frame);
+
+            if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+            j.secondaries[chunk] = secondary;
+        } catch (...) {
+            j.errors[chunk] = std::current_exception();
+        }
+        j.doneChunks.fetch_add(1, std::memory_order_release);
+    }
+}
 
-    vkCmdEndRenderPass(commandBuffer);
+void renderer::recordChunks(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    static threadpool* pool = threadpool::get_instance();
+
+    std::shared_ptr<chunkJob> j = std::make_shared<chunkJob>();
+    j->self = this;
+    j->inheritanceInfo = {};
+    j->inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    j->inheritanceInfo.renderPass = pipe.renderPass;
+    j->inheritanceInfo.subpass = 0;
+    j->inheritanceInfo.framebuffer = pipe.getFramebuffer(imageIndex);
+    j->frame = currentFrame;
+    j->chunkCount = chunkCount;
+    j->secondaries.resize(chunkCount);
+    j->errors.resize(chunkCount);
+
+    const uint32_t helpers = std::min(chunkCount - 1, std::max(1u, std::thread::hardware_concurrency()) - 1);
+    for (uint32_t i = 0; i < helpers; i++) {
+        pool->add_task([j]() { recordClaimedChunks(*j); });
+    }
 
+    //the caller records chunks as well, so nothing waits on a pool whose workers are all busy
+    recordClaimedChunks(*j);
+    while (j->doneChunks.load(std::memory_order_acquire) != j->chunkCount) {
+        std::this_thread::yield();
+    }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        throw std::runtime_error("failed to record command buffer!");
+    for (std::exception_ptr& error : j->errors) {
+        if (error)
+            std::rethrow_exception(error);
     }
+
+    vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(j->secondaries.size()), j->secondaries.data());
 }
 
 void renderer::drawFrame() {
+    if (swap.isOffscreen()) {
+        drawOffscreenFrame();
+        return;
+    }
+
     //sync.syncFrame(currentFrame);
 
     uint32_t imageIndex;
@@ -205,25 +448,43 @@ void renderer::drawFrame() {
     VkResult result = sync.acquireNextImage(currentFrame,swap.swapChain,imageIndex);
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         pipe.reCreateSwapChain();
+        invalidateCommandBuffers();
         return;
     } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
         throw std::runtime_error("failed to acquire swap chain image!");
     }
 
-    vkResetCommandBuffer(swap.commandBuffers[currentFrame], 0);
+    //the fence of this frame slot has signaled
+    inst.resetFrameCommandPools(currentFrame);
+    inst.getDeletionQueue().beginFrame(frameNumber, static_cast<uint32_t>(pipe.swapChain.framesInFlight));
+    if (frameAllocator != nullptr) {
+        frameAllocator->reset(currentFrame);
+    }
+    if (defrag != nullptr && defrag->step(currentFrame)) {
+        invalidateCommandBuffers();
+    }
+    inst.getMemoryPools().update(static_cast<uint32_t>(frameNumber));
     
     if (updateUniforms != nullptr) {
         updateUniforms(currentFrame);
     }
 
-    recordDrawCommandBuffer(swap.commandBuffers[currentFrame], imageIndex);
+    std::optional<queue::timelineWait> computeWait = submitCompute();
+
+    VkCommandBuffer commandBuffer = getDrawCommandBuffer(imageIndex);
+    if (frameAllocator != nullptr) {
+        frameAllocator->flush();
+    }
+
+    sync.submitFrame(currentFrame,1,&commandBuffer,inst.graphicsQueue,computeWait.has_value() ? &computeWait.value() : nullptr);
 
-    sync.submitFrame(currentFrame,1,&swap.commandBuffers[currentFrame],inst.graphicsQueue);
+    frameNumber++;
 
     result = sync.presentFrame(currentFrame,imageIndex,swap.swapChain,inst.presentQueue); //since my graphics queue is the same as the present queue(sync)
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || inst.win.frameBufferResized() ) {
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || inst.win->frameBufferResized() ) {
         pipe.reCreateSwapChain();
+        invalidateCommandBuffers();
     } else if (result != VK_SUCCESS) {
         throw std::runtime_error("failed to present swap chain image!");
     }
@@ -232,6 +493,261 @@ void renderer::drawFrame() {
 
 }
 
+// cached replay
+
+bool renderer::recordedState::operator==(const recordedState& other) const {
+    return generation == other.generation &&
+           pipeline == other.pipeline &&
+           renderPass == other.renderPass &&
+           framebuffer == other.framebuffer &&
+           extent.width == other.extent.width && extent.height == other.extent.height &&
+           vertexBuffers == other.vertexBuffers &&
+           vertexBufferOffsets == other.vertexBufferOffsets &&
+           indexBufferInfo.buff == other.indexBufferInfo.buff &&
+           indexBufferInfo.offset == other.indexBufferInfo.offset &&
+           indexBufferInfo.count == other.indexBufferInfo.count &&
+           indexBufferInfo.type == other.indexBufferInfo.type &&
+           indexBufferInfo.firstIndex == other.indexBufferInfo.firstIndex &&
+           indexBufferInfo.vertexOffset == other.indexBufferInfo.vertexOffset &&
+           descriptorSets == other.descriptorSets &&
+           dynamicOffsets == other.dynamicOffsets &&
+           pushConstantData == other.pushConstantData;
+}
+
+renderer::recordedState renderer::captureState(uint32_t imageIndex) {
+    recordedState state{};
+    state.generation = replayGeneration;
+    state.pipeline = pipe.graphicsPipeline;
+    state.renderPass = pipe.renderPass;
+    state.framebuffer = pipe.getFramebuffer(imageIndex);
+    state.extent = swap.swapChainExtent;
+    state.vertexBuffers = pipe.vertexBuffers;
+    state.vertexBufferOffsets = pipe.vertexBufferOffsets;
+    state.indexBufferInfo = pipe.indexBufferInfo;
+    for (uint32_t i = 0; i < pipe.builderInfo->descriptorSetLayouts.size(); i++) {
+        state.descriptorSets.push_back(pipe.descriptorSets[i][currentFrame]);
+    }
+    state.dynamicOffsets = pipe.dynamicOffsets;
+    //push constants are recorded by value
+    if (pipe.pushConstantData != nullptr && pipe.pushConstantRange.has_value()) {
+        const char* data = static_cast<const char*>(pipe.pushConstantData);
+        state.pushConstantData.assign(data, data + pipe.pushConstantRange.value().size);
+    }
+    return state;
+}
+
+void renderer::invalidateCommandBuffers() {
+    replayGeneration++;
+}
+
+VkCommandBuffer renderer::getDrawCommandBuffer(uint32_t imageIndex) {
+    if (!replayEnabled) {
+        vkResetCommandBuffer(swap.commandBuffers[currentFrame], 0);
+        recordDrawCommandBuffer(swap.commandBuffers[currentFrame], imageIndex);
+        return swap.commandBuffers[currentFrame];
+    }
+
+    if (replayCommandPool == VK_NULL_HANDLE) {
+        replayCommandPool = inst.createCommandPool(inst.getGraphicsFamily());
+        replayCommandBuffers.resize(swap.framesInFlight);
+        replayStates.resize(swap.framesInFlight);
+    }
+
+    //keyed by frame slot as well so the buffer is never pending when it is re-recorded,
+    //the fence of this frame slot covered its last submission
+    std::vector<VkCommandBuffer>& commandBuffers = replayCommandBuffers[currentFrame];
+    std::vector<recordedState>& states = replayStates[currentFrame];
+    if (commandBuffers.size() < swap.swapChainImages.size()) {
+        size_t first = commandBuffers.size();
+        commandBuffers.resize(swap.swapChainImages.size());
+        states.resize(swap.swapChainImages.size());
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = replayCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size() - first);
+
+        if (vkAllocateCommandBuffers(inst.device, &allocInfo, &commandBuffers[first]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+    }
+
+    recordedState state = captureState(imageIndex);
+    if (!(states[imageIndex] == state)) {
+        vkResetCommandBuffer(commandBuffers[imageIndex], 0);
+        //chunks inline, frame pool secondaries would not survive the next reset of this frame slot
+        recordDrawCommandBuffer(commandBuffers[imageIndex], imageIndex, false);
+        states[imageIndex] = std::move(state);
+    }
+
+    return commandBuffers[imageIndex];
+}
+
+// cached replay end
+
+// offscreen
+
+void renderer::drawOffscreenFrame() {
+    //the target of this frame is only used by this frame in flight, so the fence guards both
+    sync.syncFrame(currentFrame);
+    deliverReadback(currentFrame);
+    inst.resetFrameCommandPools(currentFrame);
+    inst.getDeletionQueue().beginFrame(frameNumber, static_cast<uint32_t>(pipe.swapChain.framesInFlight));
+    if (frameAllocator != nullptr) {
+        frameAllocator->reset(currentFrame);
+    }
+    if (defrag != nullptr && defrag->step(currentFrame)) {
+        invalidateCommandBuffers();
+    }
+    inst.getMemoryPools().update(static_cast<uint32_t>(frameNumber));
+
+    uint32_t imageIndex = currentFrame;
+
+    if (updateUniforms != nullptr) {
+        updateUniforms(currentFrame);
+    }
+
+    std::optional<queue::timelineWait> computeWait = submitCompute();
+
+    VkCommandBuffer commandBuffer = getDrawCommandBuffer(imageIndex);
+    if (frameAllocator != nullptr) {
+        frameAllocator->flush();
+    }
+
+    sync.submitOffscreenFrame(currentFrame,1,&commandBuffer,inst.graphicsQueue,computeWait.has_value() ? &computeWait.value() : nullptr);
+
+    pendingReadbacks[currentFrame] = ++frameNumber;
+
+    currentFrame = (currentFrame + 1) % pipe.swapChain.framesInFlight;
+}
+
+void renderer::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    //the render pass already left the resolve target in TRANSFER_SRC_OPTIMAL
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = swap.swapChainImages[imageIndex];
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr,
+        0, nullptr,
+        1, &imageBarrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {swap.swapChainExtent.width, swap.swapChainExtent.height, 1};
+
+    instance::svkbuffer& readback = swap.readbackBuffers[imageIndex];
+    vkCmdCopyImageToBuffer(commandBuffer, swap.swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buff, 1, &region);
+
+    VkBufferMemoryBarrier bufferBarrier{};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = readback.buff;
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr,
+        1, &bufferBarrier,
+        0, nullptr);
+}
+
+void renderer::deliverReadback(uint32_t frame) {
+    uint64_t number = pendingReadbacks[frame];
+    if (number == 0)
+        return;
+    pendingReadbacks[frame] = 0;
+
+    if (onFrameReadback == nullptr)
+        return;
+
+    instance::svkbuffer& readback = swap.readbackBuffers[frame];
+    vmaInvalidateAllocation(inst.allocator, readback.alloc, 0, VK_WHOLE_SIZE);
+    onFrameReadback(number, readback.allocInfo.pMappedData, swap.swapChainExtent);
+}
+
+void renderer::flushReadbacks() {
+    //oldest frame first so callbacks arrive in frame order
+    for (int i = 0; i < swap.framesInFlight; i++) {
+        uint32_t frame = (currentFrame + i) % swap.framesInFlight;
+        if (pendingReadbacks[frame] == 0)
+            continue;
+        vkWaitForFences(inst.device, 1, &sync.inFlightFence[frame], VK_TRUE, UINT64_MAX);
+        deliverReadback(frame);
+    }
+}
+
+// offscreen end
+
+// async compute
+
+void renderer::enableAsyncCompute(std::function<void(VkCommandBuffer,uint32_t)> recordCompute, VkPipelineStageFlags waitStage) {
+    this->recordCompute = recordCompute;
+    computeWaitStage = waitStage;
+
+    if (computeCommandPool != VK_NULL_HANDLE)
+        return;
+
+    computeTimeline = std::make_unique<queue::timeline>(inst);
+    computeCommandPool = inst.createCommandPool(inst.getComputeFamily());
+
+    computeCommandBuffers.resize(swap.framesInFlight);
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = computeCommandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(computeCommandBuffers.size());
+
+    if (vkAllocateCommandBuffers(inst.device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate compute command buffers!");
+    }
+}
+
+std::optional<queue::timelineWait> renderer::submitCompute() {
+    if (recordCompute == nullptr)
+        return std::nullopt;
+
+    //the frame fence covered the graphics submit of this slot, which waited on this slot's compute submit
+    VkCommandBuffer commandBuffer = computeCommandBuffers[currentFrame];
+    vkResetCommandBuffer(commandBuffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording compute command buffer!");
+    }
+    recordCompute(commandBuffer, currentFrame);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record compute command buffer!");
+    }
+
+    computeValue++;
+    queue::submitTimeline(inst.getComputeQueue(), 1, &commandBuffer, nullptr, computeTimeline->semaphore, computeValue, VK_NULL_HANDLE);
+
+    return queue::timelineWait{ computeTimeline->semaphore, computeValue, computeWaitStage };
+}
+
+// async compute end
+
 } // namespace svklib
 
 #endif // SVKLIB_RENDERER_HPP
@@ -9,6 +9,34 @@ namespace svklib {
 
 namespace queue {
 
+//timeline semaphore, one monotonically increasing value instead of one binary semaphore per submit
+class timeline {
+public:
+    timeline(instance& inst, uint64_t initialValue = 0);
+    ~timeline();
+    timeline(const timeline&) = delete;
+    timeline& operator=(const timeline&) = delete;
+
+    uint64_t value(); //last value signaled on the gpu
+    void wait(uint64_t value);
+    void signal(uint64_t value); //host signal
+
+    VkSemaphore semaphore;
+private:
+    instance& inst;
+};
+
+//timeline value a submission waits on before stage
+struct timelineWait {
+    VkSemaphore semaphore;
+    uint64_t value;
+    VkPipelineStageFlags stage;
+};
+
+//submits commandBuffers waiting on wait (optional) and signaling semaphore at signalValue
+void submitTimeline(instance::svkqueue& queue, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers,
+                    const timelineWait* wait, VkSemaphore semaphore, uint64_t signalValue, VkFence fence);
+
 class sync {
     friend class renderer;
 public:
@@ -17,7 +45,9 @@ public:
 
     void syncFrame(const int frame);
     VkResult acquireNextImage(const int frame, VkSwapchainKHR swapChain, uint32_t& imageIndex);
-    void submitFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue);
+    void submitFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue, const timelineWait* computeWait = nullptr);
+    //no acquire/present semaphores, only the in flight fence
+    void submitOffscreenFrame(const int frame, const uint32_t commandBufferCount, VkCommandBuffer* commandBuffers, instance::svkqueue& queue, const timelineWait* computeWait = nullptr);
     VkResult presentFrame(const int frame, const uint32_t imageIndex, VkSwapchainKHR swapChain, instance::svkqueue &queue);
 
 private:
@@ -42,6 +72,38 @@ public:
 
     void drawFrame();
     std::function<void(uint32_t)> updateUniforms = nullptr;
+    //reset to the current frame slot once its fence has signaled (before updateUniforms) and flushed before the submit
+    //allocations made in updateUniforms or recordChunk are bound through pipeline::dynamicOffsets
+    frame_allocator* frameAllocator = nullptr;
+    //stepped once per frame after the fence, relocations invalidate the cached command buffers
+    defragmenter* defrag = nullptr;
+
+    //multithreaded recording, when set the draw is split into chunkCount chunks recorded in parallel
+    //by the calling thread and threadpool workers into secondary command buffers from their frame command pools
+    //pipeline, dynamic state, vertex/index buffers, descriptor sets and push constants are already bound,
+    //recordChunk only issues the draws of its chunk
+    std::function<void(VkCommandBuffer commandBuffer, uint32_t chunk, uint32_t frame)> recordChunk = nullptr;
+    uint32_t chunkCount = 0;
+
+    //keeps a recorded command buffer per frame slot and swapchain image and resubmits it as long as
+    //the pipeline, buffers, descriptor sets, push constant data and framebuffer are unchanged
+    //chunks are recorded inline on this thread when re-recording is needed
+    bool replayEnabled = false;
+    //forces a re-record on the next use of every cached command buffer (e.g. recordChunk draws changed)
+    void invalidateCommandBuffers();
+
+    //offscreen swapchains only, called with the tightly packed pixels of a finished frame
+    //once its fence has signaled (at the latest framesInFlight frames later)
+    std::function<void(uint64_t frameNumber, const void* pixels, VkExtent2D extent)> onFrameReadback = nullptr;
+    //waits for every frame in flight and hands back all outstanding readbacks
+    void flushReadbacks();
+
+    //records compute work into its own command buffer each frame and submits it on the async compute queue,
+    //the graphics submission of the same frame waits on it at waitStage through a timeline semaphore
+    //so the dispatch overlaps the rasterization of the previous frame
+    //resources shared with graphics should come from createComputeBuffer/createComputeImage (concurrent sharing)
+    void enableAsyncCompute(std::function<void(VkCommandBuffer,uint32_t)> recordCompute,
+                            VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
 
 private:
     //references
@@ -54,9 +116,52 @@ private:
 
 public:
     uint32_t currentFrame = 0;
+    uint64_t frameNumber = 0;
 
 private:
-    void recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void recordDrawCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, bool parallelChunks = true);
+    void recordDrawState(VkCommandBuffer commandBuffer, uint32_t frame);
+    void recordChunks(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    struct chunkJob;
+    static void recordClaimedChunks(chunkJob& j);
+
+    void drawOffscreenFrame();
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+    void deliverReadback(uint32_t frame);
+    std::vector<uint64_t> pendingReadbacks; //frame number per frame in flight, 0 if none
+
+    //cached command buffer replay
+    struct recordedState {
+        uint64_t generation = 0;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent{};
+        std::vector<VkBuffer> vertexBuffers;
+        std::vector<VkDeviceSize> vertexBufferOffsets;
+        graphics::IndexBufferInfo indexBufferInfo{};
+        std::vector<VkDescriptorSet> descriptorSets;
+        std::vector<std::vector<uint32_t>> dynamicOffsets;
+        std::vector<char> pushConstantData;
+        bool operator==(const recordedState& other) const;
+    };
+    recordedState captureState(uint32_t imageIndex);
+    uint64_t replayGeneration = 1; //0 marks a never recorded buffer
+    VkCommandPool replayCommandPool = VK_NULL_HANDLE;
+    std::vector<std::vector<VkCommandBuffer>> replayCommandBuffers; //[frame][image]
+    std::vector<std::vector<recordedState>> replayStates; //[frame][image]
+    //returns the command buffer to submit for this frame, recording only when needed
+    VkCommandBuffer getDrawCommandBuffer(uint32_t imageIndex);
+
+    //async compute
+    std::function<void(VkCommandBuffer,uint32_t)> recordCompute = nullptr;
+    VkPipelineStageFlags computeWaitStage = 0;
+    std::unique_ptr<queue::timeline> computeTimeline;
+    uint64_t computeValue = 0;
+    VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+    //records and submits this frame's compute work, returns the wait for the graphics submission
+    std::optional<queue::timelineWait> submitCompute();
 
 };
 
@@ -0,0 +1,225 @@
+#ifndef SVKLIB_STAGING_CPP
+#define SVKLIB_STAGING_CPP
+
+#include "svk_staging.hpp"
+
+namespace svklib {
+
+staging_ring::staging_ring(instance& inst, VkDeviceSize size)
+    : inst(inst), size(size)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(inst.physicalDevice, &properties);
+    //16 covers every texel and BCn block size
+    defaultAlignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+
+    ring = inst.createStagingBuffer(size);
+    if (ring.allocInfo.pMappedData == nullptr) {
+        throw std::runtime_error("failed to map staging ring!");
+    }
+}
+
+staging_ring::~staging_ring()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (region& r : regions) {
+        if (r.released && r.timeline == VK_NULL_HANDLE)
+            r.future.wait();
+    }
+    regions.clear();
+    inst.destroyBuffer(ring);
+}
+
+static inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool staging_ring::isComplete(region& r)
+{
+    if (!r.released)
+        return false;
+    if (r.timeline != VK_NULL_HANDLE) {
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(inst.device, r.timeline, &value);
+        return value >= r.value;
+    }
+    return r.future.ready();
+}
+
+void staging_ring::retire(bool block)
+{
+    while (!regions.empty()) {
+        region& oldest = regions.front();
+        if (!isComplete(oldest)) {
+            if (!block || !oldest.released)
+                break;
+            //full ring, wait for the oldest upload then stop
+            if (oldest.timeline != VK_NULL_HANDLE) {
+                VkSemaphoreWaitInfo waitInfo{};
+                waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+                waitInfo.semaphoreCount = 1;
+                waitInfo.pSemaphores = &oldest.timeline;
+                waitInfo.pValues = &oldest.value;
+                vkWaitSemaphores(inst.device, &waitInfo, UINT64_MAX);
+            } else {
+                oldest.future.wait();
+            }
+            block = false;
+        }
+        regions.pop_front();
+    }
+    if (regions.empty())
+        head = 0;
+}
+
+bool staging_ring::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+    if (regions.empty()) {
+        offset = 0;
+        return size <= this->size;
+    }
+
+    const VkDeviceSize tail = regions.front().begin;
+    const VkDeviceSize aligned = alignUp(head, alignment);
+
+    if (head > tail) {
+        //free space is [head, size) and [0, tail)
+        if (aligned + size <= this->size) {
+            offset = aligned;
+            return true;
+        }
+        if (size < tail) {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+
+    //wrapped, free space is [head, tail)
+    if (aligned + size < tail) {
+        offset = aligned;
+        return true;
+    }
+    return false;
+}
+
+staging_ring::allocation staging_ring::allocateDedicated(VkDeviceSize size)
+{
+    allocation alloc{};
+    alloc.size = size;
+    alloc.dedicated = inst.createStagingBuffer(size);
+    alloc.buffer = alloc.dedicated.buff;
+    alloc.mapped = alloc.dedicated.allocInfo.pMappedData;
+    return alloc;
+}
+
+staging_ring::allocation staging_ring::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    //an empty region would leave head == tail, which reads as a full ring
+    if (size == 0)
+        return allocation{};
+
+    if (alignment == 0)
+        alignment = defaultAlignment;
+
+    if (size > this->size / 2)
+        return allocateDedicated(size);
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    retire(false);
+    VkDeviceSize offset;
+    while (!tryAllocate(size, alignment, offset)) {
+        if (regions.empty() || !regions.front().released) {
+            //the oldest region is still being written (possibly by this thread), never wait on it
+            lock.unlock();
+            return allocateDedicated(size);
+        }
+        retire(true);
+    }
+
+    allocation alloc{};
+    alloc.buffer = ring.buff;
+    alloc.offset = offset;
+    alloc.size = size;
+    alloc.mapped = static_cast<char*>(ring.allocInfo.pMappedData) + offset;
+    alloc.id = nextId++;
+
+    regions.push_back({alloc.id, offset, offset + size});
+    head = offset + size;
+
+    return alloc;
+}
+
+staging_ring::allocation staging_ring::upload(const void* data, VkDeviceSize size, VkDeviceSize alignment)
+{
+    allocation alloc = allocate(size, alignment);
+    if (size != 0)
+        memcpy(alloc.mapped, data, size);
+    flush(alloc);
+    return alloc;
+}
+
+void staging_ring::flush(const allocation& alloc)
+{
+    if (alloc.size == 0)
+        return;
+    if (alloc.id == 0) {
+        vmaFlushAllocation(inst.allocator, alloc.dedicated.alloc, 0, alloc.size);
+    } else {
+        vmaFlushAllocation(inst.allocator, ring.alloc, alloc.offset, alloc.size);
+    }
+}
+
+void staging_ring::release(allocation& alloc, instance::svkfuture future)
+{
+    if (alloc.size == 0)
+        return;
+    if (alloc.id == 0) {
+        instance::svkbuffer dedicated = alloc.dedicated;
+        instance& inst = this->inst;
+        future.then([&inst,dedicated]() mutable { inst.destroyBuffer(dedicated); });
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (region& r : regions) {
+        if (r.id == alloc.id) {
+            r.future = future;
+            r.released = true;
+            return;
+        }
+    }
+}
+
+void staging_ring::release(allocation& alloc, VkSemaphore timeline, uint64_t value)
+{
+    if (alloc.size == 0)
+        return;
+    if (alloc.id == 0) {
+        //dedicated buffers have no future to hang off, wait for the value
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(inst.device, &waitInfo, UINT64_MAX);
+        inst.destroyBuffer(alloc.dedicated);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (region& r : regions) {
+        if (r.id == alloc.id) {
+            r.timeline = timeline;
+            r.value = value;
+            r.released = true;
+            return;
+        }
+    }
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_STAGING_CPP
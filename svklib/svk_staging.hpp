@@ -0,0 +1,70 @@
+#ifndef SVKLIB_STAGING_HPP
+#define SVKLIB_STAGING_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//one persistently mapped staging buffer, sub-allocated linearly and reclaimed in submission order
+//uploads larger than half the ring, or that find it full of unsubmitted regions, get a dedicated staging buffer instead
+class staging_ring {
+public:
+    staging_ring(instance& inst, VkDeviceSize size);
+    ~staging_ring();
+    staging_ring(const staging_ring&) = delete;
+    staging_ring& operator=(const staging_ring&) = delete;
+
+    struct allocation {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mapped = nullptr;
+        uint64_t id = 0; //0 for dedicated allocations
+        instance::svkbuffer dedicated{};
+    };
+
+    //blocks on the oldest upload when the ring is full, size 0 gives an empty allocation without a buffer
+    allocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+    //allocate + memcpy + flush
+    allocation upload(const void* data, VkDeviceSize size, VkDeviceSize alignment = 0);
+    //must be called after writing through mapped and before submitting the copy
+    void flush(const allocation& alloc);
+
+    //the region is reused once the submission that reads it has completed
+    void release(allocation& alloc, instance::svkfuture future);
+    void release(allocation& alloc, VkSemaphore timeline, uint64_t value);
+
+    inline VkDeviceSize getSize() const { return size; }
+
+private:
+    instance& inst;
+    const VkDeviceSize size;
+    VkDeviceSize defaultAlignment;
+    instance::svkbuffer ring;
+
+    struct region {
+        uint64_t id;
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        bool released = false;
+        instance::svkfuture future;
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        uint64_t value = 0;
+    };
+
+    std::mutex mutex;
+    std::deque<region> regions; //oldest first
+    VkDeviceSize head = 0;
+    uint64_t nextId = 1;
+
+    allocation allocateDedicated(VkDeviceSize size);
+    bool isComplete(region& r);
+    void retire(bool block); //expects mutex held
+    bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset); //expects mutex held
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_STAGING_HPP
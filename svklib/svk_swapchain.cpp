@@ -4,6 +4,8 @@
 #include "svk_swapchain.hpp"
 
 #include "svk_instance.hpp"
+#include "svk_memory.hpp"
+#include "svk_transient.hpp"
 #include "svk_descriptor.hpp"
 #include "svk_threadpool.hpp"
 #include "svk_window.hpp"
@@ -14,6 +16,8 @@ swapchain::swapchain(instance& inst, int framesInFlight, VkImageUsageFlagBits im
     :inst(inst),samples(VK_SAMPLE_COUNT_1_BIT),framesInFlight(framesInFlight),commandPool(inst.getCommandPool()),
     preferredPresentMode(VK_PRESENT_MODE_MAILBOX_KHR), imageFlags(imageFlags | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
 {
+    if (inst.isHeadless())
+        throw std::runtime_error("swapchain requires an instance created with a window");
     createVKSwapChain();
     createImageViews();
     allocateCommandBuffers();
@@ -23,6 +27,8 @@ swapchain::swapchain(instance& inst,int framesInFlight,VkSampleCountFlagBits sam
     : inst(inst),framesInFlight(framesInFlight),samples(samples),commandPool(inst.getCommandPool()),
       preferredPresentMode(presentMode),imageFlags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
 {
+    if (inst.isHeadless())
+        throw std::runtime_error("swapchain requires an instance created with a window");
     if (samples > inst.maxMsaa)
         throw std::runtime_error("swapchain samples cannot be higher than physical device capabilities");
 
@@ -31,15 +37,41 @@ swapchain::swapchain(instance& inst,int framesInFlight,VkSampleCountFlagBits sam
     allocateCommandBuffers();
 }
 
+swapchain::swapchain(instance& inst, int framesInFlight, VkExtent2D extent, VkFormat format, VkSampleCountFlagBits samples)
+    : inst(inst),samples(samples),framesInFlight(framesInFlight),commandPool(inst.getCommandPool()),
+      preferredPresentMode(VK_PRESENT_MODE_FIFO_KHR),imageFlags(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
+      offscreen(true)
+{
+    if (samples > inst.maxMsaa)
+        throw std::runtime_error("swapchain samples cannot be higher than physical device capabilities");
+
+    swapChainImageFormat = format;
+    swapChainExtent = extent;
+
+    createOffscreenImages();
+    createImageViews();
+    createReadbackBuffers();
+    allocateCommandBuffers();
+}
+
 swapchain::~swapchain() {
+    destroyAttachments();
     freeCommandBuffers();
     commandPool.returnPool();
     destroySwapChain();
+    if (offscreen)
+        destroyReadbackBuffers();
 }
 
 void swapchain::recreateSwapChain() {
+    //rebuilt at the new extent on their next use
+    destroyAttachments();
     destroySwapChain();
-    createVKSwapChain();
+    if (offscreen) {
+        createOffscreenImages();
+    } else {
+        createVKSwapChain();
+    }
     createImageViews();
 }
 
@@ -67,7 +99,7 @@ void swapchain::createVKSwapChain() {
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = this->imageFlags;
 
-    instance::QueueFamilyIndices indices = inst.findQueueFamilies(inst.physicalDevice);
+    const instance::QueueFamilyIndices& indices = inst.queueFamilies.value();
     uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 
     if (indices.graphicsFamily != indices.presentFamily) {
@@ -99,7 +131,11 @@ void swapchain::createVKSwapChain() {
 
 void swapchain::destroySwapChain() {
     destroyImageViews();
-    vkDestroySwapchainKHR(inst.device, swapChain, nullptr);
+    if (offscreen) {
+        destroyOffscreenImages();
+    } else {
+        vkDestroySwapchainKHR(inst.device, swapChain, nullptr);
+    }
 }
 
 // void swapchain::reCreateSwapChain(VkRenderPass rendererPass) {
@@ -181,7 +217,7 @@ VkExtent2D swapchain::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilit
         return capabilities.currentExtent;
     } else {
         int width, height;
-        glfwGetFramebufferSize(inst.win.win, &width, &height);
+        glfwGetFramebufferSize(inst.win->win, &width, &height);
 
         VkExtent2D actualExtent = {
             static_cast<uint32_t>(width),
@@ -214,6 +250,189 @@ void swapchain::destroyImageViews() {
 
 // swapchain views end
 
+// offscreen targets
+
+static VkDeviceSize formatTexelSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            throw std::runtime_error("offscreen target format is not supported for readback");
+    }
+}
+
+void swapchain::createOffscreenImages() {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = swapChainImageFormat;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = imageFlags;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    //the renderer indexes targets by frame in flight, so there is exactly one per frame
+    offscreenImages.resize(framesInFlight);
+    swapChainImages.resize(framesInFlight);
+    for (int i = 0; i < framesInFlight; i++) {
+        offscreenImages[i] = inst.getMemoryPools().createImage(memory_pools::category::renderTarget, imageInfo, allocInfo);
+        swapChainImages[i] = offscreenImages[i].image;
+    }
+}
+
+void swapchain::destroyOffscreenImages() {
+    for (auto& image : offscreenImages) {
+        inst.destroyImage(image);
+    }
+    offscreenImages.clear();
+    swapChainImages.clear();
+}
+
+void swapchain::createReadbackBuffers() {
+    VkDeviceSize size = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * formatTexelSize(swapChainImageFormat);
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    //random access gives cached host memory, reading back from write-combined memory is very slow
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    readbackBuffers.resize(framesInFlight);
+    for (int i = 0; i < framesInFlight; i++) {
+        readbackBuffers[i] = inst.createBuffer(bufferInfo, allocInfo, size);
+    }
+}
+
+void swapchain::destroyReadbackBuffers() {
+    for (auto& buffer : readbackBuffers) {
+        inst.destroyBuffer(buffer);
+    }
+    readbackBuffers.clear();
+}
+
+// offscreen targets end
+
+// attachments
+
+void swapchain::createAttachments() {
+    attachments = std::make_unique<transient_attachments>(inst);
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {swapChainExtent.width, swapChainExtent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.samples = samples;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    //both are cleared on load and never stored, render passes move them out of UNDEFINED
+    imageInfo.format = swapChainImageFormat;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    colorAttachment = attachments->add(imageInfo, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    imageInfo.format = inst.findDepthFormat();
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depthAttachment = attachments->add(imageInfo, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+    attachments->build();
+}
+
+void swapchain::destroyAttachments() {
+    std::lock_guard<std::mutex> lock(attachmentMutex);
+    for (auto& [renderPass, renderPassFramebuffers] : framebuffers) {
+        for (VkFramebuffer framebuffer : renderPassFramebuffers) {
+            vkDestroyFramebuffer(inst.device, framebuffer, nullptr);
+        }
+    }
+    framebuffers.clear();
+    attachments.reset();
+}
+
+instance::svkimage& swapchain::getColorAttachment() {
+    std::lock_guard<std::mutex> lock(attachmentMutex);
+    if (attachments == nullptr)
+        createAttachments();
+    return attachments->get(colorAttachment);
+}
+
+instance::svkimage& swapchain::getDepthAttachment() {
+    std::lock_guard<std::mutex> lock(attachmentMutex);
+    if (attachments == nullptr)
+        createAttachments();
+    return attachments->get(depthAttachment);
+}
+
+VkFramebuffer swapchain::getFramebuffer(VkRenderPass renderPass, uint32_t imageIndex) {
+    std::lock_guard<std::mutex> lock(attachmentMutex);
+    auto it = framebuffers.find(renderPass);
+    if (it != framebuffers.end())
+        return it->second[imageIndex];
+
+    if (attachments == nullptr)
+        createAttachments();
+
+    std::vector<VkFramebuffer> renderPassFramebuffers(swapChainImageViews.size());
+    for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+        std::array<VkImageView,3> views = {
+            attachments->get(colorAttachment).view.value(),
+            attachments->get(depthAttachment).view.value(),
+            swapChainImageViews[i],
+        };
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+        framebufferInfo.pAttachments = views.data();
+        framebufferInfo.width = swapChainExtent.width;
+        framebufferInfo.height = swapChainExtent.height;
+        framebufferInfo.layers = 1;
+
+        if (vkCreateFramebuffer(inst.device, &framebufferInfo, nullptr, &renderPassFramebuffers[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+    }
+
+    return framebuffers.emplace(renderPass, std::move(renderPassFramebuffers)).first->second[imageIndex];
+}
+
+void swapchain::releaseFramebuffers(VkRenderPass renderPass) {
+    std::lock_guard<std::mutex> lock(attachmentMutex);
+    auto it = framebuffers.find(renderPass);
+    if (it == framebuffers.end())
+        return;
+    for (VkFramebuffer framebuffer : it->second) {
+        vkDestroyFramebuffer(inst.device, framebuffer, nullptr);
+    }
+    framebuffers.erase(it);
+}
+
+// attachments end
+
 } // namespace svklib
 
 #endif // SVKLIB_SWAPCHAIN_CPP
@@ -13,6 +13,9 @@ friend class renderer;
 public:
     swapchain(instance& inst, int framesInFlight, VkImageUsageFlagBits imageFlags,VkPresentModeKHR presentMode=VK_PRESENT_MODE_MAILBOX_KHR);
     swapchain(instance& inst, int framesInFlight, VkSampleCountFlagBits samples=VK_SAMPLE_COUNT_2_BIT, VkPresentModeKHR preferredPresentMode=VK_PRESENT_MODE_MAILBOX_KHR);
+    // offscreen target set, one color image per frame in flight (works with headless instances)
+    // finished frames are copied into readbackBuffers, see renderer::onFrameReadback
+    swapchain(instance& inst, int framesInFlight, VkExtent2D extent, VkFormat format, VkSampleCountFlagBits samples=VK_SAMPLE_COUNT_4_BIT);
     ~swapchain();
 
     swapchain(const swapchain&) = delete;
@@ -34,7 +37,10 @@ public:
     VkFormat swapChainImageFormat{};
     VkExtent2D swapChainExtent{};
     void recreateSwapChain();
+
+    inline bool isOffscreen() const { return offscreen; }
 private:
+    const bool offscreen = false;
     VkPresentModeKHR preferredPresentMode;
     VkImageUsageFlags imageFlags;
     instance::CommandPool commandPool;
@@ -59,6 +65,39 @@ private:
 
     //swapchain views end
 
+    //offscreen targets
+public:
+    //persistently mapped, tightly packed copies of the color images (one per frame in flight)
+    std::vector<instance::svkbuffer> readbackBuffers{};
+private:
+    std::vector<instance::svkimage> offscreenImages{};
+    void createOffscreenImages();
+    void destroyOffscreenImages();
+    void createReadbackBuffers();
+    void destroyReadbackBuffers();
+    //offscreen targets end
+
+    //attachments shared by every pipeline rendering into this swapchain
+public:
+    //msaa color and depth at the swapchain extent and sample count (transient_attachments),
+    //created on first use and recreated with the swapchain
+    instance::svkimage& getColorAttachment();
+    instance::svkimage& getDepthAttachment();
+    //framebuffer {color, depth, swapchain image} of imageIndex for renderPass, created on first use
+    //and cached until the swapchain is recreated, thread safe
+    VkFramebuffer getFramebuffer(VkRenderPass renderPass, uint32_t imageIndex);
+    //destroys the framebuffers of renderPass, call before destroying the render pass
+    void releaseFramebuffers(VkRenderPass renderPass);
+private:
+    std::unique_ptr<transient_attachments> attachments;
+    uint32_t colorAttachment = 0;
+    uint32_t depthAttachment = 0;
+    std::unordered_map<VkRenderPass,std::vector<VkFramebuffer>> framebuffers;
+    std::mutex attachmentMutex;
+    void createAttachments(); //expects attachmentMutex held
+    void destroyAttachments();
+    //attachments end
+
 
 
 };
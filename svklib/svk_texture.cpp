@@ -0,0 +1,795 @@
+#ifndef SVKLIB_TEXTURE_CPP
+#define SVKLIB_TEXTURE_CPP
+
+#include "svk_texture.hpp"
+
+#include "svk_upload.hpp"
+#include "svk_memory.hpp"
+#include "svk_threadpool.hpp"
+#include "svk_mips.hpp"
+
+#include "stb/stb_image.h"
+
+#include <filesystem>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace svklib {
+
+mapped_file::mapped_file(const std::string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("failed to open file: " + path);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        throw std::runtime_error("failed to map empty file: " + path);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    //the view keeps the mapping and the file alive
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    if (view == nullptr) {
+        throw std::runtime_error("failed to map file: " + path);
+    }
+    bytes = static_cast<const uint8_t*>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open file: " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("failed to map empty file: " + path);
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    //the mapping keeps the file alive
+    close(fd);
+    if (view == MAP_FAILED) {
+        throw std::runtime_error("failed to map file: " + path);
+    }
+    //read once front to back
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    bytes = static_cast<const uint8_t*>(view);
+    length = static_cast<size_t>(st.st_size);
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(bytes);
+#else
+    munmap(const_cast<uint8_t*>(bytes), length);
+#endif
+}
+
+//level offsets into the file, levels are tightly packed blocks
+struct compressedImage {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    struct level {
+        size_t offset;
+        size_t size;
+    };
+    std::vector<level> levels;
+};
+
+static uint32_t read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t read64(const uint8_t* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static constexpr uint32_t fourCC(char a, char b, char c, char d)
+{
+    return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+static bool isBlockCompressed(VkFormat format)
+{
+    return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+//bytes of one 4x4 block
+static VkDeviceSize blockBytes(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+static VkDeviceSize levelBytes(VkFormat format, uint32_t width, uint32_t height)
+{
+    return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+static uint32_t mipExtent(uint32_t extent, uint32_t level)
+{
+    return std::max(extent >> level, 1u);
+}
+
+static void checkLevels(compressedImage& image, size_t fileSize, const std::string& name)
+{
+    if (!isBlockCompressed(image.format)) {
+        throw std::runtime_error("texture is not BC1-BC7 compressed: " + name);
+    }
+    if (image.width == 0 || image.height == 0) {
+        throw std::runtime_error("texture has no extent: " + name);
+    }
+    uint32_t fullChain = 1;
+    for (uint32_t extent = std::max(image.width, image.height); extent > 1; extent >>= 1)
+        fullChain++;
+    if (image.levels.size() > fullChain) {
+        throw std::runtime_error("texture has more levels than its extent allows: " + name);
+    }
+    for (uint32_t i = 0; i < image.levels.size(); i++) {
+        const compressedImage::level& l = image.levels[i];
+        if (l.size != levelBytes(image.format, mipExtent(image.width, i), mipExtent(image.height, i)) ||
+            l.offset > fileSize || l.size > fileSize - l.offset) {
+            throw std::runtime_error("texture level is truncated or has the wrong size: " + name);
+        }
+    }
+}
+
+static constexpr uint8_t ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+static compressedImage parseKtx2(const uint8_t* data, size_t size, const std::string& name)
+{
+    //identifier, 9 header fields, dfd/kvd/sgd index, then 24 bytes per level
+    constexpr size_t levelIndexOffset = 80;
+    if (size < levelIndexOffset) {
+        throw std::runtime_error("truncated KTX2 file: " + name);
+    }
+
+    compressedImage image;
+    image.format = static_cast<VkFormat>(read32(data + 12));
+    image.width = read32(data + 20);
+    image.height = read32(data + 24);
+    const uint32_t depth = read32(data + 28);
+    const uint32_t layers = read32(data + 32);
+    const uint32_t faces = read32(data + 36);
+    const uint32_t levelCount = std::max(read32(data + 40), 1u); //0 asks the loader to generate mips, blocks cannot be blitted
+    const uint32_t supercompression = read32(data + 44);
+    if (depth != 0 || layers > 1 || faces != 1 || supercompression != 0) {
+        throw std::runtime_error("only single layer 2D KTX2 files without supercompression are supported: " + name);
+    }
+    if (levelCount > 32 || size < levelIndexOffset + levelCount * 24) {
+        throw std::runtime_error("truncated KTX2 file: " + name);
+    }
+
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const uint8_t* entry = data + levelIndexOffset + i * 24;
+        const uint64_t offset = read64(entry);
+        const uint64_t length = read64(entry + 8);
+        if (offset > size || length > size) {
+            throw std::runtime_error("truncated KTX2 file: " + name);
+        }
+        image.levels.push_back({static_cast<size_t>(offset), static_cast<size_t>(length)});
+    }
+    checkLevels(image, size, name);
+    return image;
+}
+
+static VkFormat ddsFourCCFormat(uint32_t code)
+{
+    switch (code) {
+        case fourCC('D','X','T','1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case fourCC('D','X','T','3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+        case fourCC('D','X','T','5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+        case fourCC('A','T','I','1'):
+        case fourCC('B','C','4','U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+        case fourCC('B','C','4','S'): return VK_FORMAT_BC4_SNORM_BLOCK;
+        case fourCC('A','T','I','2'):
+        case fourCC('B','C','5','U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+        case fourCC('B','C','5','S'): return VK_FORMAT_BC5_SNORM_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static VkFormat ddsDxgiFormat(uint32_t dxgiFormat)
+{
+    switch (dxgiFormat) {
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+static compressedImage parseDds(const uint8_t* data, size_t size, const std::string& name)
+{
+    //magic + 124 byte header, + 20 byte DX10 header
+    constexpr uint32_t mipMapCountFlag = 0x20000;
+    constexpr uint32_t fourCCFlag = 0x4;
+    constexpr uint32_t cubemapOrVolumeCaps = 0x200 | 0x200000;
+    if (size < 128) {
+        throw std::runtime_error("truncated DDS file: " + name);
+    }
+
+    compressedImage image;
+    const uint32_t flags = read32(data + 8);
+    image.height = read32(data + 12);
+    image.width = read32(data + 16);
+    const uint32_t levelCount = (flags & mipMapCountFlag) ? std::max(read32(data + 28), 1u) : 1;
+    const uint32_t pixelFormatFlags = read32(data + 80);
+    const uint32_t code = read32(data + 84);
+    const uint32_t caps2 = read32(data + 112);
+    if (!(pixelFormatFlags & fourCCFlag) || (caps2 & cubemapOrVolumeCaps)) {
+        throw std::runtime_error("only block compressed 2D DDS files are supported: " + name);
+    }
+
+    size_t offset = 128;
+    if (code == fourCC('D','X','1','0')) {
+        if (size < 148) {
+            throw std::runtime_error("truncated DDS file: " + name);
+        }
+        const uint32_t dimension = read32(data + 132);
+        const uint32_t miscFlag = read32(data + 136);
+        const uint32_t arraySize = read32(data + 140);
+        if (dimension != 3 || (miscFlag & 0x4) || arraySize > 1) {
+            throw std::runtime_error("only single layer 2D DDS files are supported: " + name);
+        }
+        image.format = ddsDxgiFormat(read32(data + 128));
+        offset = 148;
+    } else {
+        image.format = ddsFourCCFormat(code);
+    }
+    if (!isBlockCompressed(image.format) || image.width == 0 || image.height == 0 || levelCount > 32) {
+        throw std::runtime_error("unsupported DDS file: " + name);
+    }
+
+    //levels follow each other without padding
+    for (uint32_t i = 0; i < levelCount; i++) {
+        const size_t levelSize = static_cast<size_t>(levelBytes(image.format, mipExtent(image.width, i), mipExtent(image.height, i)));
+        image.levels.push_back({offset, levelSize});
+        offset += levelSize;
+    }
+    checkLevels(image, size, name);
+    return image;
+}
+
+static compressedImage parseCompressed(const uint8_t* data, size_t size, const std::string& name)
+{
+    if (size >= sizeof(ktx2Identifier) && memcmp(data, ktx2Identifier, sizeof(ktx2Identifier)) == 0)
+        return parseKtx2(data, size, name);
+    if (size >= 4 && read32(data) == fourCC('D','D','S',' '))
+        return parseDds(data, size, name);
+    throw std::runtime_error("not a KTX2 or DDS file: " + name);
+}
+
+texture_loader::texture_loader(instance& inst, VkDeviceSize bytesPerSubmit, VkCommandPool commandPool)
+    : inst(inst), bytesPerSubmit(bytesPerSubmit), commandPool(commandPool)
+{}
+
+texture_loader::~texture_loader()
+{
+    wait();
+}
+
+//written under a private name and renamed, so readers never see a partial file
+static void writeAtomically(const std::string& path, const void* header, size_t headerSize, const void* data, size_t size)
+{
+    std::ostringstream unique;
+    unique << path << "." << std::this_thread::get_id() << ".tmp";
+    const std::string tempPath = unique.str();
+
+    FILE* handle = fopen(tempPath.c_str(), "wb");
+    if (handle == nullptr) {
+        throw std::runtime_error("failed to open file: " + tempPath);
+    }
+    const bool written = fwrite(header, headerSize, 1, handle) == 1 && fwrite(data, 1, size, handle) == size;
+    fclose(handle);
+    if (!written) {
+        std::filesystem::remove(tempPath);
+        throw std::runtime_error("failed to write file: " + path);
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        //another thread or process got there first
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+texture_cache::texture_cache(std::string directory, VkFormat format)
+    : directory(std::move(directory)), format(bcn_encoder::fromVkFormat(format))
+{
+    std::filesystem::create_directories(this->directory);
+}
+
+//fnv-1a
+uint64_t texture_cache::hash(const uint8_t* data, size_t size)
+{
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        h ^= data[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+//a cached file may be truncated or damaged (crash during a write on some filesystems, disk errors)
+static bool isUsable(const std::string& path, VkFormat format)
+{
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+        return false;
+    try {
+        mapped_file file(path);
+        return parseCompressed(file.data(), file.size(), path).format == format;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+std::string texture_cache::get(const std::string& source, uint32_t mipLevels, bool srgb)
+{
+    static const char* formatNames[] = {"bc1", "bc3", "bc7"};
+
+    mapped_file file(source);
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-v%u-%s%s-%u.dds", static_cast<unsigned long long>(hash(file.data(), file.size())),
+        version, formatNames[static_cast<int>(format)], srgb ? "-srgb" : "", mipLevels);
+    const std::string path = (std::filesystem::path(directory) / name).string();
+    //anything else is encoded again and replaces the file
+    if (isUsable(path, getFormat(srgb)))
+        return path;
+
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image: " + source);
+    }
+    const uint32_t width = static_cast<uint32_t>(texWidth);
+    const uint32_t height = static_cast<uint32_t>(texHeight);
+    const uint32_t levels = std::clamp(mipLevels, 1u, mip_generator::fullChain(width, height));
+
+    std::vector<uint8_t> pyramid(static_cast<size_t>(mip_generator::pyramidSize(width, height, levels)));
+    mip_generator::build(pixels, width, height, levels, srgb, pyramid.data());
+    stbi_image_free(pixels);
+
+    VkDeviceSize encodedSize = 0;
+    for (uint32_t i = 0; i < levels; i++)
+        encodedSize += bcn_encoder::encodedSize(format, mipExtent(width, i), mipExtent(height, i));
+    std::vector<uint8_t> encoded(static_cast<size_t>(encodedSize));
+
+    size_t levelOffset = 0;
+    VkDeviceSize offset = 0;
+    for (uint32_t i = 0; i < levels; i++) {
+        const uint32_t levelWidth = mipExtent(width, i);
+        const uint32_t levelHeight = mipExtent(height, i);
+        bcn_encoder::encode(format, pyramid.data() + levelOffset, levelWidth, levelHeight, encoded.data() + offset);
+        levelOffset += static_cast<size_t>(levelWidth) * levelHeight * 4;
+        offset += bcn_encoder::encodedSize(format, levelWidth, levelHeight);
+    }
+
+    write(path, encoded.data(), encoded.size(), width, height, levels, srgb);
+    return path;
+}
+
+void texture_cache::write(const std::string& path, const uint8_t* encoded, size_t size, uint32_t width, uint32_t height, uint32_t mipLevels, bool srgb)
+{
+    //DDS with the DX10 header, which is the only way to describe BC7
+    uint32_t header[37] = {};
+    header[0] = fourCC('D','D','S',' ');
+    header[1] = 124;
+    header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; //caps, height, width, pixel format, mip count, linear size
+    header[3] = height;
+    header[4] = width;
+    header[5] = static_cast<uint32_t>(bcn_encoder::encodedSize(format, width, height));
+    header[7] = mipLevels;
+    header[19] = 32; //pixel format size
+    header[20] = 0x4; //four cc
+    header[21] = fourCC('D','X','1','0');
+    header[27] = 0x1000 | (mipLevels > 1 ? 0x400000 | 0x8 : 0); //texture, mipmap, complex
+    switch (format) {
+        case bcn_encoder::format::bc1: header[32] = srgb ? 72 : 71; break;
+        case bcn_encoder::format::bc3: header[32] = srgb ? 78 : 77; break;
+        case bcn_encoder::format::bc7: header[32] = srgb ? 99 : 98; break;
+    }
+    header[33] = 3; //texture 2D
+    header[35] = 1; //array size
+
+    writeAtomically(path, header, sizeof(header), encoded, size);
+}
+
+uint32_t texture_loader::add(const char* file, uint32_t mipLevels, VkFormat format)
+{
+    //decode always expands to 4 bytes per texel
+    if (format != VK_FORMAT_R8G8B8A8_SRGB && format != VK_FORMAT_R8G8B8A8_UNORM &&
+        format != VK_FORMAT_B8G8R8A8_SRGB && format != VK_FORMAT_B8G8R8A8_UNORM) {
+        throw std::runtime_error("texture_loader only loads rgba8 and bgra8 formats: " + std::string(file));
+    }
+    requests.push_back({file, mipLevels, format, false, inst.getTextureCache() != nullptr});
+    return static_cast<uint32_t>(requests.size() - 1);
+}
+
+uint32_t texture_loader::addCompressed(const char* file)
+{
+    requests.push_back({file, 0, VK_FORMAT_UNDEFINED, true, false});
+    return static_cast<uint32_t>(requests.size() - 1);
+}
+
+bool texture_loader::supportsCompressed()
+{
+    return inst.hasTextureCompressionBC();
+}
+
+//header of <file>.mips, the packed levels of mip_generator::build follow
+struct pyramidHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t srgb;
+};
+static constexpr uint32_t pyramidMagic = fourCC('S','V','K','M');
+static constexpr uint32_t pyramidVersion = 1;
+
+bool texture_loader::loadPyramid(const request& r, decoded& result)
+{
+    const std::string path = r.file + ".mips";
+    std::error_code error;
+    const auto pyramidTime = std::filesystem::last_write_time(path, error);
+    if (error)
+        return false;
+    //stale once the source is saved again
+    const auto sourceTime = std::filesystem::last_write_time(r.file, error);
+    if (error || pyramidTime < sourceTime)
+        return false;
+
+    //unreadable or damaged files count as a miss and are rebuilt from the source
+    std::unique_ptr<mapped_file> mapping;
+    try {
+        mapping = std::make_unique<mapped_file>(path);
+    } catch (const std::exception&) {
+        return false;
+    }
+    const mapped_file& file = *mapping;
+    pyramidHeader header;
+    if (file.size() < sizeof(header))
+        return false;
+    memcpy(&header, file.data(), sizeof(header));
+    if (header.magic != pyramidMagic || header.version != pyramidVersion || header.width == 0 || header.height == 0 ||
+        header.srgb != (mip_generator::isSrgb(r.format) ? 1u : 0u) ||
+        header.levels != std::min(r.mipLevels, mip_generator::fullChain(header.width, header.height)))
+        return false;
+    const VkDeviceSize size = mip_generator::pyramidSize(header.width, header.height, header.levels);
+    if (file.size() != sizeof(header) + size)
+        return false;
+
+    staging_ring& stagingRing = inst.getStagingRing();
+    result.stage = stagingRing.allocate(size);
+    memcpy(result.stage.mapped, file.data() + sizeof(header), size);
+    stagingRing.flush(result.stage);
+
+    result.width = header.width;
+    result.height = header.height;
+    result.mipLevels = header.levels;
+    result.regions = mip_generator::regions(header.width, header.height, header.levels);
+    return true;
+}
+
+void texture_loader::decode(const request& r, decoded& result)
+{
+    try {
+        result.format = r.format;
+        result.mipLevels = r.mipLevels;
+        //rgba8 mips are built here instead of being blitted after the upload
+        const bool pyramid = r.mipLevels > 1 && mip_generator::supports(r.format);
+        if (pyramid && pyramidCache && loadPyramid(r, result))
+            return;
+
+        int texWidth, texHeight, texChannels;
+        std::unique_ptr<stbi_uc, void(*)(void*)> pixels(stbi_load(r.file.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha), stbi_image_free);
+        if (!pixels) {
+            throw std::runtime_error("failed to load texture image: " + r.file);
+        }
+        result.width = static_cast<uint32_t>(texWidth);
+        result.height = static_cast<uint32_t>(texHeight);
+
+        //the copy runs here so the calling thread never touches texels
+        staging_ring& stagingRing = inst.getStagingRing();
+        if (!pyramid) {
+            const VkDeviceSize size = static_cast<VkDeviceSize>(texWidth) * texHeight * 4;
+            result.stage = stagingRing.allocate(size);
+            memcpy(result.stage.mapped, pixels.get(), size);
+            stagingRing.flush(result.stage);
+            return;
+        }
+
+        const uint32_t levels = std::min(r.mipLevels, mip_generator::fullChain(result.width, result.height));
+        const bool srgb = mip_generator::isSrgb(r.format);
+        const VkDeviceSize size = mip_generator::pyramidSize(result.width, result.height, levels);
+        if (pyramidCache) {
+            std::vector<uint8_t> levelData(static_cast<size_t>(size));
+            mip_generator::build(pixels.get(), result.width, result.height, levels, srgb, levelData.data());
+            const pyramidHeader header{pyramidMagic, pyramidVersion, result.width, result.height, levels, srgb ? 1u : 0u};
+            try {
+                writeAtomically(r.file + ".mips", &header, sizeof(header), levelData.data(), levelData.size());
+            } catch (const std::exception&) {
+                //the source directory may be read only, the load itself still succeeds
+            }
+            result.stage = stagingRing.allocate(size);
+            memcpy(result.stage.mapped, levelData.data(), levelData.size());
+        } else {
+            //straight into staging, build only writes its output
+            result.stage = stagingRing.allocate(size);
+            mip_generator::build(pixels.get(), result.width, result.height, levels, srgb, static_cast<uint8_t*>(result.stage.mapped));
+        }
+        stagingRing.flush(result.stage);
+
+        result.mipLevels = levels;
+        result.regions = mip_generator::regions(result.width, result.height, levels);
+    } catch (...) {
+        //exceptions must not escape into the pool
+        result.error = std::current_exception();
+    }
+}
+
+void texture_loader::decodeCompressed(const request& r, decoded& result)
+{
+    try {
+        mapped_file file(r.file);
+        const compressedImage image = parseCompressed(file.data(), file.size(), r.file);
+        if (!inst.hasTextureCompressionBC() || !inst.supportsFormat(image.format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+            throw std::runtime_error("texture format is not supported by this device: " + r.file);
+        }
+
+        VkDeviceSize size = 0;
+        for (const compressedImage::level& l : image.levels)
+            size += l.size;
+
+        //offsets of copies from block compressed images must be multiples of the block size
+        staging_ring& stagingRing = inst.getStagingRing();
+        result.stage = stagingRing.allocate(size, 16);
+
+        VkDeviceSize offset = 0;
+        for (uint32_t level = 0; level < image.levels.size(); level++) {
+            const compressedImage::level& l = image.levels[level];
+            memcpy(static_cast<uint8_t*>(result.stage.mapped) + offset, file.data() + l.offset, l.size);
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {mipExtent(image.width, level), mipExtent(image.height, level), 1};
+            result.regions.push_back(region);
+
+            offset += l.size;
+        }
+        stagingRing.flush(result.stage);
+
+        result.width = image.width;
+        result.height = image.height;
+        result.format = image.format;
+        result.mipLevels = static_cast<uint32_t>(image.levels.size());
+    } catch (...) {
+        result.error = std::current_exception();
+    }
+}
+
+struct texture_loader::job {
+    texture_loader* loader;
+    std::vector<request> pending;
+    std::vector<decoded> results;
+    std::deque<std::atomic_bool> done;
+    std::atomic<size_t> next{0};
+};
+
+void texture_loader::decodeNext(job& j)
+{
+    //files are claimed, so a task that starts after everything was taken does nothing
+    const size_t i = j.next.fetch_add(1);
+    if (i >= j.pending.size())
+        return;
+
+    const request& r = j.pending[i];
+    decoded& result = j.results[i];
+    texture_loader& loader = *j.loader;
+    if (r.cached) {
+        //encoding a miss runs here too, its tiles are shared with idle workers
+        try {
+            const bool srgb = r.format == VK_FORMAT_R8G8B8A8_SRGB || r.format == VK_FORMAT_B8G8R8A8_SRGB;
+            request compressed{loader.inst.getTextureCache()->get(r.file, r.mipLevels, srgb), 0, VK_FORMAT_UNDEFINED, true, false};
+            loader.decodeCompressed(compressed, result);
+        } catch (...) {
+            result.error = std::current_exception();
+        }
+    } else if (r.compressed) {
+        loader.decodeCompressed(r, result);
+    } else {
+        loader.decode(r, result);
+    }
+    j.done[i].store(true, std::memory_order_release);
+}
+
+std::vector<instance::svkimage> texture_loader::load()
+{
+    std::shared_ptr<job> j = std::make_shared<job>();
+    j->loader = this;
+    j->pending = std::move(requests);
+    requests.clear();
+    const std::vector<request>& pending = j->pending;
+    std::vector<decoded>& results = j->results;
+    results.resize(pending.size());
+    for (size_t i = 0; i < pending.size(); i++)
+        j->done.emplace_back(false);
+
+    threadpool* pool = threadpool::get_instance();
+    for (size_t i = 0; i < pending.size(); i++)
+        pool->add_task([j]() { decodeNext(*j); });
+
+    //record in completion order, one slow file does not hold back the rest
+    std::vector<instance::svkimage> images(pending.size());
+    std::vector<bool> recorded(pending.size(), false);
+    std::vector<bool> created(pending.size(), false);
+    std::exception_ptr error;
+    upload_batch batch(inst, commandPool);
+    VkDeviceSize batchBytes = 0;
+    size_t remaining = pending.size();
+
+    while (remaining != 0) {
+        bool progressed = false;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (recorded[i] || j->done[i].load(std::memory_order_acquire) != true)
+                continue;
+            recorded[i] = true;
+            remaining--;
+            progressed = true;
+
+            decoded& result = results[i];
+            if (result.error) {
+                if (!error)
+                    error = result.error;
+                continue;
+            }
+            if (error) {
+                //the load fails anyway, skip the upload
+                inst.getStagingRing().release(result.stage, instance::svkfuture());
+                continue;
+            }
+
+            //compressed files and rgba8 pyramids come with every level staged
+            const bool levelsStaged = !result.regions.empty();
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent.width = result.width;
+            imageInfo.extent.height = result.height;
+            imageInfo.extent.depth = 1;
+            imageInfo.mipLevels = result.mipLevels;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = result.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            //nothing is blitted from uploaded levels
+            if (levelsStaged)
+                imageInfo.usage &= ~VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VmaAllocationCreateInfo allocInfo{};
+            allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+            allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+            const VkDeviceSize size = result.stage.size;
+            try {
+                inst.getMemoryPools().selectPool(memory_pools::category::texture, imageInfo, allocInfo);
+            } catch (...) {
+                error = std::current_exception();
+                inst.getStagingRing().release(result.stage, instance::svkfuture());
+                continue;
+            }
+            //the batch releases the staging region from here on, even when it throws
+            try {
+                if (levelsStaged)
+                    images[i] = batch.addImageLevels(imageInfo, allocInfo, result.stage, std::move(result.regions));
+                else
+                    images[i] = batch.addImage(imageInfo, allocInfo, result.stage);
+                created[i] = true;
+            } catch (...) {
+                error = std::current_exception();
+                continue;
+            }
+
+            batchBytes += size;
+            if (batchBytes >= bytesPerSubmit) {
+                futures.push_back(batch.submit());
+                batchBytes = 0;
+            }
+        }
+        //nothing to record, decode a file here instead of waiting on workers that may all be busy
+        if (!progressed) {
+            if (j->next.load() < pending.size())
+                decodeNext(*j);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    if (!batch.empty())
+        futures.push_back(batch.submit());
+
+    if (error) {
+        wait();
+        for (size_t i = 0; i < images.size(); i++) {
+            if (created[i])
+                inst.destroyImage(images[i]);
+        }
+        std::rethrow_exception(error);
+    }
+
+    return images;
+}
+
+bool texture_loader::ready()
+{
+    std::erase_if(futures, [](instance::svkfuture& future) { return future.ready(); });
+    return futures.empty();
+}
+
+void texture_loader::wait()
+{
+    for (instance::svkfuture& future : futures) {
+        future.wait();
+    }
+    futures.clear();
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_TEXTURE_CPP
@@ -0,0 +1,124 @@
+#ifndef SVKLIB_TEXTURE_HPP
+#define SVKLIB_TEXTURE_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+#include "svk_staging.hpp"
+#include "svk_bcn.hpp"
+
+namespace svklib {
+
+//read only view of a whole file, mmap on posix and a file mapping on windows
+class mapped_file {
+public:
+    mapped_file(const std::string& path); //throws when the file cannot be mapped
+    ~mapped_file();
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    inline const uint8_t* data() const { return bytes; }
+    inline size_t size() const { return length; }
+
+private:
+    const uint8_t* bytes = nullptr;
+    size_t length = 0;
+};
+
+//block compressed copies of png/jpg/bmp textures, keyed by a hash of the source file contents
+//a miss decodes the source, builds its mips and encodes every level on the cpu, then writes a DDS file
+//into directory, later runs map that file and skip decoding entirely, files that fail to parse are encoded again
+class texture_cache {
+public:
+    //format picks the encoding (BC1, BC3 or BC7), the srgb/unorm variant is chosen per get()
+    texture_cache(std::string directory, VkFormat format = VK_FORMAT_BC7_SRGB_BLOCK);
+
+    //thread safe, returns the path of the cached file, encodes and writes it first on a miss
+    std::string get(const std::string& source, uint32_t mipLevels, bool srgb);
+    inline VkFormat getFormat(bool srgb) const { return bcn_encoder::toVkFormat(format, srgb); }
+
+    //part of every file name, bump it whenever the encoder or the mip filter changes its output
+    //so files written by older builds are never picked up again
+    //2: mips are filtered in linear space for srgb formats
+    static constexpr uint32_t version = 2;
+
+private:
+    const std::string directory;
+    const bcn_encoder::format format;
+
+    static uint64_t hash(const uint8_t* data, size_t size);
+    void write(const std::string& path, const uint8_t* encoded, size_t size, uint32_t width, uint32_t height, uint32_t mipLevels, bool srgb);
+};
+
+//loads many textures at once, files are decoded in parallel on the threadpool and each worker
+//writes its texels into its own staging region, the calling thread creates images and records,
+//and decodes files itself while it has nothing to record, so load() also works from a threadpool task
+//mips of rgba8 formats are built on the workers too and uploaded with the base level
+//recorded images are submitted every bytesPerSubmit staged bytes so the staging ring recycles during the load
+class texture_loader {
+public:
+    //commandPool is passed on to the upload batches, see upload_batch
+    texture_loader(instance& inst, VkDeviceSize bytesPerSubmit = instance::stagingRingSize / 2, VkCommandPool commandPool = VK_NULL_HANDLE);
+    ~texture_loader(); //waits for the uploads
+    texture_loader(const texture_loader&) = delete;
+    texture_loader& operator=(const texture_loader&) = delete;
+
+    //returns the index of the image in the vector returned by load()
+    //format must be an rgba8 or bgra8 format, files are always decoded to 4 channels
+    //with a texture cache enabled on the instance, the file is loaded block compressed through the cache
+    uint32_t add(const char* file, uint32_t mipLevels, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+    //KTX2 or DDS holding BC1-BC7 blocks, every level in the file is mapped and copied into staging as is
+    //needs textureCompressionBC, check supportsCompressed() first
+    uint32_t addCompressed(const char* file);
+    bool supportsCompressed();
+
+    //decodes and uploads everything added since the last load, blocks until every file is recorded
+    //the images are usable once the uploads are complete (ready() or wait())
+    //throws if any file fails, the images of the other files are destroyed first
+    std::vector<instance::svkimage> load();
+
+    bool ready(); //non blocking
+    void wait();
+
+    //mip pyramids built for add() are also written to <file>.mips and reused while newer than the source
+    inline void setPyramidCache(bool enabled) { pyramidCache = enabled; }
+
+private:
+    instance& inst;
+    const VkDeviceSize bytesPerSubmit;
+    const VkCommandPool commandPool;
+    bool pyramidCache = false;
+
+    struct request {
+        std::string file;
+        uint32_t mipLevels;
+        VkFormat format;
+        bool compressed;
+        bool cached; //compressed through the texture cache
+    };
+    struct decoded {
+        staging_ring::allocation stage;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t mipLevels = 1;
+        std::vector<VkBufferImageCopy> regions; //one per level when every level is staged, empty when mips are blitted
+        std::exception_ptr error;
+    };
+
+    std::vector<request> requests;
+    std::vector<instance::svkfuture> futures;
+
+    //shared with the decode tasks, which may start after load() returned
+    struct job;
+    static void decodeNext(job& j);
+
+    //runs on a worker or the loading thread
+    void decode(const request& r, decoded& result);
+    void decodeCompressed(const request& r, decoded& result);
+    bool loadPyramid(const request& r, decoded& result); //false when there is no usable <file>.mips
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_TEXTURE_HPP
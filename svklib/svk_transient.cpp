@@ -0,0 +1,186 @@
+#ifndef SVKLIB_TRANSIENT_CPP
+#define SVKLIB_TRANSIENT_CPP
+
+#include "svk_transient.hpp"
+
+#include "svk_memory.hpp"
+
+namespace svklib {
+
+transient_attachments::transient_attachments(instance& inst)
+    : inst(inst)
+{}
+
+transient_attachments::~transient_attachments()
+{
+    clear();
+}
+
+uint32_t transient_attachments::add(VkImageCreateInfo imageInfo, VkImageAspectFlags aspectFlags, uint32_t firstPass, uint32_t lastPass)
+{
+    if (firstPass > lastPass) {
+        throw std::runtime_error("transient attachment ends before it starts!");
+    }
+    //the contents of aliased memory are undefined when an attachment starts
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    attachment a{};
+    a.imageInfo = imageInfo;
+    a.aspectFlags = aspectFlags;
+    a.firstPass = firstPass;
+    a.lastPass = lastPass;
+    attachments.push_back(a);
+    return static_cast<uint32_t>(attachments.size() - 1);
+}
+
+VmaAllocationCreateInfo transient_attachments::allocationInfo(instance& inst, const VkImageCreateInfo& imageInfo)
+{
+    VmaAllocationCreateInfo allocInfo{};
+    if (imageInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+        allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+        uint32_t memoryTypeIndex;
+        if (vmaFindMemoryTypeIndexForImageInfo(inst.allocator, &imageInfo, &allocInfo, &memoryTypeIndex) == VK_SUCCESS)
+            return allocInfo;
+    }
+    allocInfo = {};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    return allocInfo;
+}
+
+bool transient_attachments::allocateLazily(attachment& a)
+{
+    if ((a.imageInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) == 0)
+        return false;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+    allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    uint32_t memoryTypeIndex;
+    if (vmaFindMemoryTypeIndex(inst.allocator, a.requirements.memoryTypeBits, &allocInfo, &memoryTypeIndex) != VK_SUCCESS)
+        return false; //no lazily allocated memory on this device
+
+    inst.getMemoryPools().selectPool(memory_pools::category::renderTarget, a.requirements, allocInfo);
+    if (vmaAllocateMemoryForImage(inst.allocator, a.image.image, &allocInfo, &a.image.alloc, &a.image.allocInfo) != VK_SUCCESS)
+        return false;
+    if (vmaBindImageMemory(inst.allocator, a.image.alloc, a.image.image) != VK_SUCCESS) {
+        vmaFreeMemory(inst.allocator, a.image.alloc);
+        return false;
+    }
+    a.lazy = true;
+    return true;
+}
+
+bool transient_attachments::fits(const slot& s, const attachment& a)
+{
+    if ((s.requirements.memoryTypeBits & a.requirements.memoryTypeBits) == 0)
+        return false;
+    for (uint32_t id : s.attachments) {
+        const attachment& other = attachments[id];
+        if (a.firstPass <= other.lastPass && other.firstPass <= a.lastPass)
+            return false;
+    }
+    return true;
+}
+
+void transient_attachments::build()
+{
+    std::vector<uint32_t> shared;
+    for (uint32_t id = 0; id < attachments.size(); id++) {
+        attachment& a = attachments[id];
+        if (a.built)
+            continue;
+
+        if (vkCreateImage(inst.device, &a.imageInfo, nullptr, &a.image.image) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create transient attachment!");
+        }
+        vkGetImageMemoryRequirements(inst.device, a.image.image, &a.requirements);
+        a.image.mipLevels = a.imageInfo.mipLevels;
+        a.image.format = a.imageInfo.format;
+        requestedBytes += a.requirements.size;
+
+        if (!allocateLazily(a))
+            shared.push_back(id);
+    }
+
+    //largest first so the small attachments fill the slots of the large ones
+    std::sort(shared.begin(), shared.end(), [this](uint32_t a, uint32_t b) {
+        return attachments[a].requirements.size > attachments[b].requirements.size;
+    });
+
+    //only slots of this build, the memory of earlier slots is already allocated
+    const size_t firstSlot = slots.size();
+    for (uint32_t id : shared) {
+        attachment& a = attachments[id];
+        auto it = std::find_if(slots.begin() + firstSlot, slots.end(), [&](const slot& s) { return fits(s, a); });
+        if (it == slots.end()) {
+            slots.push_back({});
+            it = slots.end() - 1;
+            it->requirements = a.requirements;
+        }
+        it->requirements.size = std::max(it->requirements.size, a.requirements.size);
+        it->requirements.alignment = std::max(it->requirements.alignment, a.requirements.alignment);
+        it->requirements.memoryTypeBits &= a.requirements.memoryTypeBits;
+        it->attachments.push_back(id);
+    }
+
+    for (size_t i = firstSlot; i < slots.size(); i++) {
+        slot& s = slots[i];
+
+        VmaAllocationCreateInfo allocInfo{};
+        allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+        inst.getMemoryPools().selectPool(memory_pools::category::renderTarget, s.requirements, allocInfo);
+        if (vmaAllocateMemory(inst.allocator, &s.requirements, &allocInfo, &s.alloc, nullptr) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate transient attachment memory!");
+        }
+        committedBytes += s.requirements.size;
+
+        for (uint32_t id : s.attachments) {
+            attachment& a = attachments[id];
+            if (vmaBindImageMemory(inst.allocator, s.alloc, a.image.image) != VK_SUCCESS) {
+                throw std::runtime_error("failed to bind transient attachment memory!");
+            }
+            a.image.alloc = s.alloc;
+            vmaGetAllocationInfo(inst.allocator, s.alloc, &a.image.allocInfo);
+        }
+    }
+
+    for (attachment& a : attachments) {
+        if (a.built)
+            continue;
+        a.image.view = createImageView(inst.device, a.image.image, a.imageInfo.format, VK_IMAGE_VIEW_TYPE_2D, a.aspectFlags, a.imageInfo.mipLevels);
+        a.built = true;
+    }
+}
+
+instance::svkimage& transient_attachments::get(uint32_t id)
+{
+    if (id >= attachments.size() || !attachments[id].built) {
+        throw std::runtime_error("transient attachment is not built!");
+    }
+    return attachments[id].image;
+}
+
+void transient_attachments::clear()
+{
+    for (attachment& a : attachments) {
+        if (a.image.view.has_value())
+            inst.destroyImageView(a.image.view.value());
+        if (a.image.image != VK_NULL_HANDLE)
+            vkDestroyImage(inst.device, a.image.image, nullptr);
+        if (a.lazy)
+            vmaFreeMemory(inst.allocator, a.image.alloc);
+    }
+    for (slot& s : slots) {
+        if (s.alloc != VK_NULL_HANDLE)
+            vmaFreeMemory(inst.allocator, s.alloc);
+    }
+    attachments.clear();
+    slots.clear();
+    requestedBytes = 0;
+    committedBytes = 0;
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_TRANSIENT_CPP
@@ -0,0 +1,73 @@
+#ifndef SVKLIB_TRANSIENT_HPP
+#define SVKLIB_TRANSIENT_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+
+namespace svklib {
+
+//attachments whose contents never outlive a frame (msaa color, depth, intermediate targets)
+//images with TRANSIENT_ATTACHMENT usage get lazily allocated memory when the device has it (tilers),
+//the driver then only commits tile memory instead of the whole image
+//the others share memory with attachments whose pass ranges do not overlap, which requires their
+//render passes to start them from VK_IMAGE_LAYOUT_UNDEFINED and to be ordered by dependencies
+class transient_attachments {
+public:
+    transient_attachments(instance& inst);
+    ~transient_attachments();
+    transient_attachments(const transient_attachments&) = delete;
+    transient_attachments& operator=(const transient_attachments&) = delete;
+
+    //firstPass/lastPass are the first and last pass of the frame using the attachment, in submission order
+    //returns the id for get(), only valid until clear()
+    uint32_t add(VkImageCreateInfo imageInfo, VkImageAspectFlags aspectFlags, uint32_t firstPass = 0, uint32_t lastPass = 0);
+    //creates the images and views of everything added since the last build
+    void build();
+    //owned by this class, never pass it to instance::destroyImage
+    instance::svkimage& get(uint32_t id);
+    //destroys every attachment, the gpu must be done with them
+    void clear();
+
+    //for a single attachment created on its own, lazily allocated when imageInfo has TRANSIENT_ATTACHMENT usage
+    //and the device has such memory, GPU_ONLY otherwise
+    static VmaAllocationCreateInfo allocationInfo(instance& inst, const VkImageCreateInfo& imageInfo);
+
+    inline bool isLazilyAllocated(uint32_t id) const { return attachments[id].lazy; }
+    //memory the attachments would take if each had its own
+    inline VkDeviceSize getRequestedBytes() const { return requestedBytes; }
+    //memory actually allocated up front, lazily allocated attachments count as 0
+    inline VkDeviceSize getCommittedBytes() const { return committedBytes; }
+
+private:
+    instance& inst;
+
+    struct attachment {
+        VkImageCreateInfo imageInfo;
+        VkImageAspectFlags aspectFlags;
+        uint32_t firstPass;
+        uint32_t lastPass;
+        instance::svkimage image{};
+        VkMemoryRequirements requirements{};
+        bool lazy = false;
+        bool built = false;
+    };
+    //memory shared by attachments with disjoint pass ranges
+    struct slot {
+        VmaAllocation alloc = VK_NULL_HANDLE;
+        VkMemoryRequirements requirements{};
+        std::vector<uint32_t> attachments;
+    };
+
+    std::vector<attachment> attachments;
+    std::vector<slot> slots;
+    VkDeviceSize requestedBytes = 0;
+    VkDeviceSize committedBytes = 0;
+
+    bool allocateLazily(attachment& a);
+    bool fits(const slot& s, const attachment& a);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_TRANSIENT_HPP
@@ -0,0 +1,519 @@
+#ifndef SVKLIB_UPLOAD_CPP
+#define SVKLIB_UPLOAD_CPP
+
+#include "svk_upload.hpp"
+#include "svk_memory.hpp"
+#include "svk_mips.hpp"
+
+#include "stb/stb_image.h"
+
+namespace svklib {
+
+upload_batch::upload_batch(instance& inst, VkCommandPool commandPool)
+    : inst(inst), commandPool(commandPool)
+{}
+
+upload_batch::~upload_batch()
+{
+    //pending staging regions would otherwise block the ring forever
+    if (!empty())
+        submit().wait();
+}
+
+instance::svkbuffer upload_batch::addBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize size, const void* data)
+{
+    instance::svkbuffer buffer = inst.createDeviceBuffer(bufferUsage,size);
+    //written right away on ReBAR/UMA devices, nothing to record
+    if (!inst.writeBufferDirect(buffer,0,data,size)) {
+        addBufferCopy(buffer.buff,0,data,size,bufferUsage);
+        buffers.back().created = true;
+    }
+    return buffer;
+}
+
+void upload_batch::addBufferCopy(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkBufferUsageFlags bufferUsage, bool concurrent)
+{
+    pendingBuffer pending{};
+    pending.dst = dst;
+    pending.dstOffset = dstOffset;
+    pending.size = size;
+    pending.dstAccess = instance::bufferUsageAccessMask(bufferUsage);
+    pending.concurrent = concurrent;
+    pending.stage = inst.getStagingRing().upload(data,size);
+    buffers.push_back(pending);
+}
+
+//bytes per texel of the uncompressed color formats addImage accepts, 0 for everything else
+static VkDeviceSize texelBytes(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SRGB:
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+instance::svkimage upload_batch::addImage(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, const void* data)
+{
+    const VkDeviceSize bytes = texelBytes(imageInfo.format);
+    if (bytes == 0) {
+        throw std::runtime_error("upload_batch::addImage only takes uncompressed color formats");
+    }
+
+    //mips of rgba8 formats are built on the cpu and every level goes up in one copy, no blit support needed
+    if (imageInfo.mipLevels > 1 && imageInfo.extent.depth == 1 && mip_generator::supports(imageInfo.format)) {
+        const uint32_t width = imageInfo.extent.width;
+        const uint32_t height = imageInfo.extent.height;
+        imageInfo.mipLevels = std::min(imageInfo.mipLevels, mip_generator::fullChain(width, height));
+
+        staging_ring& stagingRing = inst.getStagingRing();
+        staging_ring::allocation stage = stagingRing.allocate(mip_generator::pyramidSize(width, height, imageInfo.mipLevels));
+        mip_generator::build(static_cast<const uint8_t*>(data), width, height, imageInfo.mipLevels,
+            mip_generator::isSrgb(imageInfo.format), static_cast<uint8_t*>(stage.mapped));
+        stagingRing.flush(stage);
+        return addImageLevels(imageInfo, allocInfo, stage, mip_generator::regions(width, height, imageInfo.mipLevels));
+    }
+
+    const VkDeviceSize size = static_cast<VkDeviceSize>(imageInfo.extent.width) * imageInfo.extent.height * imageInfo.extent.depth * bytes;
+    return addImage(imageInfo,allocInfo,inst.getStagingRing().upload(data,size));
+}
+
+instance::svkimage upload_batch::addImage(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, staging_ring::allocation stage)
+{
+    instance::svkimage image;
+    try {
+        if (texelBytes(imageInfo.format) == 0) {
+            throw std::runtime_error("upload_batch::addImage only takes uncompressed color formats");
+        }
+        if (imageInfo.mipLevels > 1) {
+            VkFormatProperties formatProperties;
+            vkGetPhysicalDeviceFormatProperties(inst.physicalDevice, imageInfo.format, &formatProperties);
+            if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+                throw std::runtime_error("texture image format does not support linear blitting!");
+            }
+        }
+        image = inst.createImage(imageInfo,allocInfo);
+    } catch (...) {
+        //nothing reads the region, hand it straight back
+        inst.getStagingRing().release(stage,instance::svkfuture());
+        throw;
+    }
+
+    pendingImage pending{};
+    pending.image = image.image;
+    pending.format = imageInfo.format;
+    pending.extent = imageInfo.extent;
+    pending.mipLevels = image.mipLevels;
+    pending.stage = stage;
+    images.push_back(pending);
+
+    return image;
+}
+
+instance::svkimage upload_batch::addImageLevels(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, staging_ring::allocation stage, std::vector<VkBufferImageCopy> regions)
+{
+    instance::svkimage image;
+    try {
+        if (regions.empty()) {
+            throw std::runtime_error("image upload has no regions!");
+        }
+        image = inst.createImage(imageInfo,allocInfo);
+    } catch (...) {
+        inst.getStagingRing().release(stage,instance::svkfuture());
+        throw;
+    }
+
+    for (VkBufferImageCopy& region : regions)
+        region.bufferOffset += stage.offset;
+
+    pendingImage pending{};
+    pending.image = image.image;
+    pending.format = imageInfo.format;
+    pending.extent = imageInfo.extent;
+    pending.mipLevels = image.mipLevels;
+    pending.stage = stage;
+    pending.regions = std::move(regions);
+    images.push_back(std::move(pending));
+
+    return image;
+}
+
+instance::svkimage upload_batch::add2DImageFromFile(const char* file, uint32_t mipLevels)
+{
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(file, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = texWidth;
+    imageInfo.extent.height = texHeight;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    inst.getMemoryPools().selectPool(memory_pools::category::texture,imageInfo,allocInfo);
+
+    //the pixels are copied into staging memory right away
+    instance::svkimage image = addImage(imageInfo,allocInfo,pixels);
+
+    stbi_image_free(pixels);
+
+    return image;
+}
+
+static VkImageMemoryBarrier imageBarrier(VkImage image, uint32_t baseMipLevel, uint32_t levelCount, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = baseMipLevel;
+    barrier.subresourceRange.levelCount = levelCount;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = srcAccessMask;
+    barrier.dstAccessMask = dstAccessMask;
+    return barrier;
+}
+
+bool upload_batch::copiedWithUploads(const pendingBuffer& pending)
+{
+    //existing exclusive buffers would need an acquire on the transfer queue first, or their other contents are lost
+    //concurrent ones have no owner, the caller guarantees the range is not in use
+    return pending.created || pending.concurrent;
+}
+
+void upload_batch::recordCopies(VkCommandBuffer commandBuffer)
+{
+    //every image to TRANSFER_DST in one barrier
+    std::vector<VkImageMemoryBarrier> barriers;
+    barriers.reserve(images.size());
+    for (pendingImage& pending : images) {
+        barriers.push_back(imageBarrier(pending.image,0,pending.mipLevels,
+            VK_IMAGE_LAYOUT_UNDEFINED,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,0,VK_ACCESS_TRANSFER_WRITE_BIT));
+    }
+    if (!barriers.empty()) {
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    //one vkCmdCopyBuffer per source/destination pair
+    std::map<std::pair<VkBuffer,VkBuffer>,std::vector<VkBufferCopy>> copies;
+    for (pendingBuffer& pending : buffers) {
+        if (!copiedWithUploads(pending))
+            continue;
+        VkBufferCopy region{};
+        region.srcOffset = pending.stage.offset;
+        region.dstOffset = pending.dstOffset;
+        region.size = pending.size;
+        copies[{pending.stage.buffer,pending.dst}].push_back(region);
+    }
+    for (auto& [pair, regions] : copies) {
+        vkCmdCopyBuffer(commandBuffer, pair.first, pair.second, static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    for (pendingImage& pending : images) {
+        if (!pending.regions.empty()) {
+            vkCmdCopyBufferToImage(commandBuffer, pending.stage.buffer, pending.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(pending.regions.size()), pending.regions.data());
+            continue;
+        }
+        VkBufferImageCopy region{};
+        region.bufferOffset = pending.stage.offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = {0, 0, 0};
+        region.imageExtent = pending.extent;
+
+        vkCmdCopyBufferToImage(commandBuffer, pending.stage.buffer, pending.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    }
+}
+
+void upload_batch::recordExistingBufferCopies(VkCommandBuffer commandBuffer)
+{
+    std::map<std::pair<VkBuffer,VkBuffer>,std::vector<VkBufferCopy>> copies;
+    for (pendingBuffer& pending : buffers) {
+        if (copiedWithUploads(pending))
+            continue;
+        VkBufferCopy region{};
+        region.srcOffset = pending.stage.offset;
+        region.dstOffset = pending.dstOffset;
+        region.size = pending.size;
+        copies[{pending.stage.buffer,pending.dst}].push_back(region);
+    }
+    if (copies.empty())
+        return;
+
+    //waits for everything submitted earlier on this queue, frames in flight may still read the old data
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &memoryBarrier,
+        0, nullptr,
+        0, nullptr);
+
+    for (auto& [pair, regions] : copies) {
+        vkCmdCopyBuffer(commandBuffer, pair.first, pair.second, static_cast<uint32_t>(regions.size()), regions.data());
+    }
+}
+
+void upload_batch::recordOwnershipBarriers(VkCommandBuffer commandBuffer, bool release)
+{
+    const uint32_t transferFamily = inst.getQueueFamily(instance::QueueType::transfer);
+    const uint32_t graphicsFamily = inst.getQueueFamily(instance::QueueType::graphics);
+
+    std::map<VkBuffer,VkAccessFlags> dstAccess;
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    bool concurrentBarrier = false;
+    for (pendingBuffer& pending : buffers) {
+        if (!copiedWithUploads(pending))
+            continue;
+        if (pending.concurrent) {
+            memoryBarrier.dstAccessMask |= pending.dstAccess;
+            concurrentBarrier = true;
+        } else {
+            dstAccess[pending.dst] |= pending.dstAccess;
+        }
+    }
+    //concurrent buffers only need their writes made available before the semaphore, the acquire side makes them visible
+    memoryBarrier.srcAccessMask = release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+    memoryBarrier.dstAccessMask = release ? 0 : memoryBarrier.dstAccessMask;
+
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    bufferBarriers.reserve(dstAccess.size());
+    for (auto& [buffer, access] : dstAccess) {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        barrier.srcAccessMask = release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+        barrier.dstAccessMask = release ? 0 : access;
+        bufferBarriers.push_back(barrier);
+    }
+
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    imageBarriers.reserve(images.size());
+    for (pendingImage& pending : images) {
+        VkImageMemoryBarrier barrier = imageBarrier(pending.image,0,pending.mipLevels,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0,
+            release ? 0 : VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+        barrier.srcQueueFamilyIndex = transferFamily;
+        barrier.dstQueueFamilyIndex = graphicsFamily;
+        imageBarriers.push_back(barrier);
+    }
+
+    if (!concurrentBarrier && bufferBarriers.empty() && imageBarriers.empty())
+        return;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        release ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        concurrentBarrier ? 1 : 0, &memoryBarrier,
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void upload_batch::recordMipmaps(VkCommandBuffer commandBuffer)
+{
+    uint32_t maxLevels = 1;
+    std::vector<VkOffset3D> mipSizes(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].regions.empty())
+            maxLevels = std::max(maxLevels,images[i].mipLevels);
+        mipSizes[i] = {static_cast<int32_t>(images[i].extent.width),static_cast<int32_t>(images[i].extent.height),static_cast<int32_t>(images[i].extent.depth)};
+    }
+
+    std::vector<VkImageMemoryBarrier> barriers;
+    barriers.reserve(images.size());
+    for (uint32_t level = 1; level < maxLevels; level++) {
+        barriers.clear();
+        for (pendingImage& pending : images) {
+            if (level < pending.mipLevels && pending.regions.empty()) {
+                barriers.push_back(imageBarrier(pending.image,level - 1,1,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_ACCESS_TRANSFER_WRITE_BIT,VK_ACCESS_TRANSFER_READ_BIT));
+            }
+        }
+        vkCmdPipelineBarrier(commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        for (size_t i = 0; i < images.size(); i++) {
+            if (level >= images[i].mipLevels || !images[i].regions.empty())
+                continue;
+            VkOffset3D& mipSize = mipSizes[i];
+
+            VkImageBlit blit{};
+            blit.srcOffsets[0] = { 0, 0, 0 };
+            blit.srcOffsets[1] = mipSize;
+            blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.srcSubresource.mipLevel = level - 1;
+            blit.srcSubresource.baseArrayLayer = 0;
+            blit.srcSubresource.layerCount = 1;
+            blit.dstOffsets[0] = { 0, 0, 0 };
+            blit.dstOffsets[1] = { mipSize.x > 1 ? mipSize.x / 2 : 1, mipSize.y > 1 ? mipSize.y / 2 : 1, mipSize.z > 1 ? mipSize.z / 2 : 1 };
+            blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            blit.dstSubresource.mipLevel = level;
+            blit.dstSubresource.baseArrayLayer = 0;
+            blit.dstSubresource.layerCount = 1;
+
+            vkCmdBlitImage(commandBuffer,
+                images[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                images[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                1, &blit,
+                VK_FILTER_LINEAR);
+
+            mipSize = blit.dstOffsets[1];
+        }
+    }
+}
+
+void upload_batch::recordFinalBarrier(VkCommandBuffer commandBuffer, bool dedicatedTransfer)
+{
+    //blitted mip chains end with every level but the last in TRANSFER_SRC
+    std::vector<VkImageMemoryBarrier> barriers;
+    barriers.reserve(images.size() * 2);
+    for (pendingImage& pending : images) {
+        if (!pending.regions.empty()) {
+            barriers.push_back(imageBarrier(pending.image,0,pending.mipLevels,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_WRITE_BIT,VK_ACCESS_SHADER_READ_BIT));
+            continue;
+        }
+        if (pending.mipLevels > 1) {
+            barriers.push_back(imageBarrier(pending.image,0,pending.mipLevels - 1,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_ACCESS_TRANSFER_READ_BIT,VK_ACCESS_SHADER_READ_BIT));
+        }
+        barriers.push_back(imageBarrier(pending.image,pending.mipLevels - 1,1,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT,VK_ACCESS_SHADER_READ_BIT));
+    }
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    //buffers written on the transfer queue were made visible by the acquire
+    for (pendingBuffer& pending : buffers) {
+        if (!dedicatedTransfer || !copiedWithUploads(pending))
+            memoryBarrier.dstAccessMask |= pending.dstAccess;
+    }
+    const bool bufferBarrier = memoryBarrier.dstAccessMask != 0;
+
+    if (barriers.empty() && !bufferBarrier)
+        return;
+
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        bufferBarrier ? 1 : 0, &memoryBarrier,
+        0, nullptr,
+        static_cast<uint32_t>(barriers.size()), barriers.data());
+}
+
+instance::svkfuture upload_batch::submit()
+{
+    if (empty())
+        return instance::svkfuture();
+
+    instance::CommandPool borrowedPool = inst.getCommandPool();
+    const VkCommandPool graphicsPool = commandPool != VK_NULL_HANDLE ? commandPool : borrowedPool.get();
+    instance::svkfuture future;
+
+    if (inst.hasDedicatedTransferQueue()) {
+        //copies on the transfer queue, mips are blitted on graphics after the acquire
+        //and updates of existing buffers go there too
+        instance::CommandPool transferPool = inst.getTransferCommandPool();
+        VkCommandBuffer transferCommands = inst.beginSingleTimeCommands(transferPool.get());
+        recordCopies(transferCommands);
+        recordOwnershipBarriers(transferCommands,true);
+
+        VkCommandBuffer acquireCommands = inst.beginSingleTimeCommands(graphicsPool);
+        recordOwnershipBarriers(acquireCommands,false);
+        recordExistingBufferCopies(acquireCommands);
+        recordMipmaps(acquireCommands);
+        recordFinalBarrier(acquireCommands,true);
+
+        future = inst.endOwnershipTransferAsync(transferPool.get(),transferCommands,graphicsPool,acquireCommands);
+
+        //the transfer pool stays borrowed until its command buffer is done
+        instance::ThreadCommandPool* poolEntry = transferPool.detach();
+        future.then([poolEntry]() { poolEntry->borrowed.store(false,std::memory_order_release); });
+    } else {
+        VkCommandBuffer commandBuffer = inst.beginSingleTimeCommands(graphicsPool);
+        recordCopies(commandBuffer);
+        recordExistingBufferCopies(commandBuffer);
+        recordMipmaps(commandBuffer);
+        recordFinalBarrier(commandBuffer,false);
+        future = inst.endSingleTimeCommandsAsync(graphicsPool,commandBuffer);
+    }
+
+    staging_ring& stagingRing = inst.getStagingRing();
+    for (pendingBuffer& pending : buffers)
+        stagingRing.release(pending.stage,future);
+    for (pendingImage& pending : images)
+        stagingRing.release(pending.stage,future);
+
+    buffers.clear();
+    images.clear();
+
+    return future;
+}
+
+} // namespace svklib
+
+#endif // SVKLIB_UPLOAD_CPP
@@ -0,0 +1,86 @@
+#ifndef SVKLIB_UPLOAD_HPP
+#define SVKLIB_UPLOAD_HPP
+
+#include "svk_forward_declarations.hpp"
+
+#include "svk_instance.hpp"
+#include "svk_staging.hpp"
+
+namespace svklib {
+
+//collects many uploads and records them into one command buffer with merged barriers
+//resources returned by add* are usable once the future returned by submit() has completed
+//one batch is recorded by one thread, it is reusable after submit()
+class upload_batch {
+public:
+    //graphics commands go into commandPool when given, otherwise into a pool borrowed per submit
+    //a given pool must outlive the futures returned by submit()
+    upload_batch(instance& inst, VkCommandPool commandPool = VK_NULL_HANDLE);
+    ~upload_batch(); //submits and waits if anything is still pending
+    upload_batch(const upload_batch&) = delete;
+    upload_batch& operator=(const upload_batch&) = delete;
+
+    //Transfer bit already selected
+    instance::svkbuffer addBuffer(VkBufferUsageFlags bufferUsage, VkDeviceSize size, const void* data);
+    //overwrites part of an existing buffer, usage decides what the data is made visible to
+    //copied on the graphics queue after all work submitted before, so the rest of the buffer keeps its contents
+    //and frames still reading it finish first, later submissions see the new data
+    //concurrent buffers (VK_SHARING_MODE_CONCURRENT) may go on the transfer queue instead, without any ordering
+    //against the graphics queue, only set it when the range is not in use (e.g. freshly allocated)
+    void addBufferCopy(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkBufferUsageFlags bufferUsage, bool concurrent = false);
+
+    //tightly packed texels of an uncompressed color format, mips are generated when imageInfo.mipLevels > 1,
+    //on the cpu for rgba8 formats (gamma correct for srgb) and blitted otherwise, ends in SHADER_READ_ONLY_OPTIMAL
+    instance::svkimage addImage(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, const void* data);
+    //same, the texels are already written and flushed, the batch takes over releasing stage
+    instance::svkimage addImage(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, staging_ring::allocation stage);
+    //every level comes from stage, nothing is blitted, so block compressed formats work too
+    //bufferOffset of the regions is relative to the start of stage, ends in SHADER_READ_ONLY_OPTIMAL
+    instance::svkimage addImageLevels(VkImageCreateInfo imageInfo, VmaAllocationCreateInfo allocInfo, staging_ring::allocation stage, std::vector<VkBufferImageCopy> regions);
+    instance::svkimage add2DImageFromFile(const char* file, uint32_t mipLevels);
+
+    inline bool empty() const { return buffers.empty() && images.empty(); }
+
+    instance::svkfuture submit();
+
+private:
+    instance& inst;
+    const VkCommandPool commandPool;
+
+    struct pendingBuffer {
+        VkBuffer dst;
+        VkDeviceSize dstOffset;
+        VkDeviceSize size;
+        VkAccessFlags dstAccess;
+        bool created; //by addBuffer, nothing else can be using it
+        bool concurrent;
+        staging_ring::allocation stage;
+    };
+    struct pendingImage {
+        VkImage image;
+        VkFormat format;
+        VkExtent3D extent;
+        uint32_t mipLevels;
+        staging_ring::allocation stage;
+        std::vector<VkBufferImageCopy> regions; //empty: level 0 is copied, the rest blitted
+    };
+
+    std::vector<pendingBuffer> buffers;
+    std::vector<pendingImage> images;
+
+    //buffers created by the batch and idle concurrent ranges can be written on the transfer queue, other existing ones only on graphics
+    static bool copiedWithUploads(const pendingBuffer& pending);
+    //images and buffers created by the batch
+    void recordCopies(VkCommandBuffer commandBuffer);
+    //copies into existing buffers, always on the graphics queue (after the acquire)
+    void recordExistingBufferCopies(VkCommandBuffer commandBuffer);
+    //queue family ownership transfer of every destination, layouts are kept
+    void recordOwnershipBarriers(VkCommandBuffer commandBuffer, bool release);
+    //blits every mip chain level by level, one barrier per level for all images
+    void recordMipmaps(VkCommandBuffer commandBuffer);
+    void recordFinalBarrier(VkCommandBuffer commandBuffer, bool dedicatedTransfer);
+};
+
+} // namespace svklib
+
+#endif // SVKLIB_UPLOAD_HPP
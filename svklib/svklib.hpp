@@ -3,6 +3,18 @@
 
 #include "svk_window.hpp"
 #include "svk_instance.hpp"
+#include "svk_staging.hpp"
+#include "svk_upload.hpp"
+#include "svk_geometry.hpp"
+#include "svk_frame_allocator.hpp"
+#include "svk_defrag.hpp"
+#include "svk_memory.hpp"
+#include "svk_deletion.hpp"
+#include "svk_transient.hpp"
+#include "svk_handles.hpp"
+#include "svk_bcn.hpp"
+#include "svk_mips.hpp"
+#include "svk_texture.hpp"
 #include "svk_swapchain.hpp"
 #include "svk_pipeline.hpp"
 #include "svk_renderer.hpp"